@@ -1,8 +1,9 @@
+#include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
-int bc[2];
+uint64_t bc[2];
 
 // Update branch information.
 // A conditional branch is taken if <taken> is true.
@@ -14,10 +15,18 @@ void updateBranchInfo(bool taken) {
   bc[1] += 1;
 }
 
+// Adds <taken> taken conditional branches out of <total>, counted in bulk
+// by loops whose counters were promoted.
+extern "C" __attribute__((visibility("default")))
+void addBranchInfo(uint64_t taken, uint64_t total) {
+  bc[0] += taken;
+  bc[1] += total;
+}
+
 extern "C" __attribute__((visibility("default")))
 void printOutBranchInfo() {
-  fprintf(stderr, "taken\t%d\n", bc[0]);
-  fprintf(stderr, "total\t%d\n", bc[1]);
+  fprintf(stderr, "taken\t%" PRIu64 "\n", bc[0]);
+  fprintf(stderr, "total\t%" PRIu64 "\n", bc[1]);
 
   bc[0] = bc[1] = 0;
 }
@@ -0,0 +1,107 @@
+#include "profile_format.h"
+
+#include <map>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// Block coverage flags registered by instrumented functions. A flag is a
+// byte that the block sets to 1; at exit they are packed into one bitmap
+// (see profile_format.h).
+
+struct FlagRegion {
+  uint64_t func_hash;
+  uint64_t cfg_checksum;
+  const char* name;
+  uint32_t num_blocks;
+  const uint8_t* flags;
+};
+
+// Allocated on first use, registration runs from other constructors.
+static std::vector<FlagRegion>* regions;
+
+// $LLVM_PASS_COVERAGE, default llvm-pass.%p.cov, with %p replaced by the pid.
+static std::string coveragePath() {
+  const char* env = getenv("LLVM_PASS_COVERAGE");
+  std::string path = env != nullptr ? env : "llvm-pass.%p.cov";
+  size_t pos = path.find("%p");
+
+  if (pos != std::string::npos) {
+    path.replace(pos, 2, std::to_string(getpid()));
+  }
+  return path;
+}
+
+static void writeCoverage() {
+  // Inline functions are instrumented in every module that emits them, so
+  // one function may have registered several flag arrays. A block ran if
+  // any of its flags is set.
+  std::map<uint64_t, std::vector<const FlagRegion*>> funcs;
+
+  for (const FlagRegion& region : *regions) {
+    funcs[region.func_hash].push_back(&region);
+  }
+
+  std::vector<cov_function> functions;
+  std::vector<uint8_t> bitmap;
+  std::string names;
+  uint64_t bit = 0;
+
+  for (const auto& func : funcs) {
+    const FlagRegion* first = func.second[0];
+    size_t len = strlen(first->name);
+    cov_function entry = {func.first, first->cfg_checksum, names.size(), len,
+                          bit, first->num_blocks};
+
+    functions.push_back(entry);
+    names.append(first->name, len);
+
+    bitmap.resize((bit + first->num_blocks + 7) / 8, 0);
+    for (uint32_t i = 0; i < first->num_blocks; ++i, ++bit) {
+      for (const FlagRegion* region : func.second) {
+        if (region->num_blocks == first->num_blocks && region->flags[i] != 0) {
+          bitmap[bit / 8] |= 1 << (bit % 8);
+          break;
+        }
+      }
+    }
+  }
+
+  cov_header header;
+  memcpy(header.magic, COV_MAGIC, 4);
+  header.version = COV_VERSION;
+  header.num_functions = functions.size();
+  header.bitmap_size = bitmap.size();
+  header.names_size = names.size();
+
+  std::string path = coveragePath();
+  FILE* file = fopen(path.c_str(), "wb");
+
+  if (file == nullptr) {
+    fprintf(stderr, "cannot write coverage %s\n", path.c_str());
+    return;
+  }
+  fwrite(&header, sizeof(header), 1, file);
+  fwrite(functions.data(), sizeof(cov_function), functions.size(), file);
+  fwrite(bitmap.data(), 1, bitmap.size(), file);
+  fwrite(names.data(), 1, names.size(), file);
+  fclose(file);
+}
+
+// Registers the <num_blocks> coverage flags of the function <name>, called
+// from module constructors emitted by the instrumentation.
+extern "C" __attribute__((visibility("default")))
+void registerCoverageFlags(uint64_t func_hash, uint64_t cfg_checksum,
+                           const char* name, uint32_t num_blocks,
+                           const uint8_t* flags) {
+  if (regions == nullptr) {
+    regions = new std::vector<FlagRegion>();
+    atexit(writeCoverage);
+  }
+
+  FlagRegion region = {func_hash, cfg_checksum, name, num_blocks, flags};
+  regions->push_back(region);
+}
@@ -0,0 +1,187 @@
+#include "profile_format.h"
+
+#include <algorithm>
+#include <atomic>
+#include <dlfcn.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <ucontext.h>
+#include <vector>
+
+// PC sampling. A SIGPROF timer interrupts the program every
+// $LLVM_PASS_SAMPLE_INTERVAL microseconds of CPU time (default 1000), and
+// the handler counts the interrupted PC in a fixed lock-free table. At exit
+// the PCs are mapped to blocks through the address tables registered by
+// the pcs pass and handed to the profile writer (lib/lib_prof.cc) as
+// PROF_SAMPLES counters. The instrumented code itself runs unchanged.
+
+#define PCS_TABLE_SIZE (1 << 16)
+#define PCS_MAX_PROBES 64
+
+extern "C" void registerProfileCounters(uint32_t kind, uint32_t site, uint64_t func_hash,
+                                        uint64_t cfg_checksum, const char* name,
+                                        uint32_t num_counters, uint64_t* counters);
+
+struct SampledFunction {
+  uint32_t num_blocks;
+  const void* const* addresses;
+  uint64_t* counters;
+};
+
+// Distinct sampled PCs and how often each was seen.
+struct PCSlot {
+  std::atomic<uintptr_t> pc;
+  std::atomic<uint64_t> count;
+};
+
+static std::vector<SampledFunction>* functions;
+static PCSlot pc_table[PCS_TABLE_SIZE];
+static std::atomic<uint64_t> dropped;
+
+static uintptr_t contextPC(void* context) {
+  ucontext_t* uc = static_cast<ucontext_t*>(context);
+#if defined(__x86_64__)
+  return uc->uc_mcontext.gregs[REG_RIP];
+#elif defined(__i386__)
+  return uc->uc_mcontext.gregs[REG_EIP];
+#elif defined(__aarch64__)
+  return uc->uc_mcontext.pc;
+#else
+#error "PC sampling is not supported on this architecture"
+#endif
+}
+
+// Runs in the signal handler, so it only touches the preallocated table.
+static void onSample(int, siginfo_t*, void* context) {
+  uintptr_t pc = contextPC(context);
+  size_t i = (pc * 0x9e3779b97f4a7c15ULL) >> 48;
+
+  for (int probe = 0; probe < PCS_MAX_PROBES; ++probe) {
+    PCSlot& slot = pc_table[(i + probe) % PCS_TABLE_SIZE];
+    uintptr_t cur = slot.pc.load(std::memory_order_relaxed);
+
+    if (cur == 0 && slot.pc.compare_exchange_strong(cur, pc, std::memory_order_relaxed)) {
+      cur = pc;
+    }
+    if (cur == pc) {
+      slot.count.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+  }
+  dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Start of a block in the program.
+struct BlockStart {
+  uintptr_t address;
+  uint32_t func;
+  uint32_t block;
+
+  bool operator<(const BlockStart& other) const {
+    return address < other.address;
+  }
+};
+
+// Whether <pc> lies in the code of the block starting at <start> rather
+// than in some other code after it: in the same object, and with no symbol
+// starting in between. dladdr only sees dynamic symbols, which is enough to
+// tell uninstrumented libraries and exported functions apart.
+static bool inBlock(uintptr_t pc, uintptr_t start) {
+  Dl_info pc_info, start_info;
+
+  if (dladdr((void*) pc, &pc_info) == 0 || dladdr((void*) start, &start_info) == 0) {
+    return true;
+  }
+  return pc_info.dli_fbase == start_info.dli_fbase &&
+         (pc_info.dli_saddr == nullptr || (uintptr_t) pc_info.dli_saddr <= start);
+}
+
+// Stops sampling and adds every sampled PC to the counter of the block it
+// fell in. Runs before the profile is written.
+static void resolveSamples() {
+  struct itimerval timer = {{0, 0}, {0, 0}};
+  setitimer(ITIMER_PROF, &timer, nullptr);
+  signal(SIGPROF, SIG_IGN);
+
+  std::vector<BlockStart> starts;
+  for (uint32_t f = 0; f < functions->size(); ++f) {
+    const SampledFunction& func = (*functions)[f];
+    for (uint32_t b = 0; b < func.num_blocks; ++b) {
+      if (func.addresses[b] != nullptr) {
+        BlockStart start = {(uintptr_t) func.addresses[b], f, b};
+        starts.push_back(start);
+      }
+    }
+  }
+  std::sort(starts.begin(), starts.end());
+
+  for (PCSlot& slot : pc_table) {
+    uintptr_t pc = slot.pc.load(std::memory_order_relaxed);
+    uint64_t count = slot.count.load(std::memory_order_relaxed);
+    if (pc == 0) {
+      continue;
+    }
+
+    BlockStart key = {pc, 0, 0};
+    auto it = std::upper_bound(starts.begin(), starts.end(), key);
+    // PCs outside the instrumented code are not counted.
+    if (it == starts.begin() || !inBlock(pc, (it - 1)->address)) {
+      continue;
+    }
+    --it;
+    (*functions)[it->func].counters[it->block] += count;
+  }
+
+  if (dropped.load(std::memory_order_relaxed) > 0) {
+    fprintf(stderr, "PC sampling: %llu samples dropped, too many distinct PCs\n",
+            (unsigned long long) dropped.load(std::memory_order_relaxed));
+  }
+}
+
+// Installs the handler and starts the timer, on the first registration.
+static void initSampling() {
+  if (functions != nullptr) {
+    return;
+  }
+  functions = new std::vector<SampledFunction>();
+
+  const char* env = getenv("LLVM_PASS_SAMPLE_INTERVAL");
+  long interval = env != nullptr && atol(env) > 0 ? atol(env) : 1000;
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_sigaction = onSample;
+  action.sa_flags = SA_RESTART | SA_SIGINFO;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGPROF, &action, nullptr);
+
+  struct itimerval timer;
+  timer.it_interval.tv_sec = interval / 1000000;
+  timer.it_interval.tv_usec = interval % 1000000;
+  timer.it_value = timer.it_interval;
+  setitimer(ITIMER_PROF, &timer, nullptr);
+}
+
+// Registers the function <name>, whose <num_blocks> blocks start at
+// <addresses> (null for blocks without an address).
+extern "C" __attribute__((visibility("default")))
+void registerSampledFunction(uint64_t func_hash, uint64_t cfg_checksum, const char* name,
+                             uint32_t num_blocks, const void* const* addresses) {
+  bool first = functions == nullptr;
+  initSampling();
+
+  SampledFunction func = {num_blocks, addresses, new uint64_t[num_blocks]()};
+  functions->push_back(func);
+  registerProfileCounters(PROF_SAMPLES, 0, func_hash, cfg_checksum, name, num_blocks,
+                          func.counters);
+
+  // Exit handlers run in reverse, and the profile writer was registered by
+  // the call above, so the samples are resolved before it runs.
+  if (first) {
+    atexit(resolveSamples);
+  }
+}
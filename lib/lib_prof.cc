@@ -0,0 +1,323 @@
+#include "profile_format.h"
+
+#include <algorithm>
+#include <map>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// Counter arrays registered by instrumented functions, written out as one
+// binary profile (see profile_format.h) when the program exits.
+
+struct CounterRegion {
+  uint32_t kind;
+  uint32_t site;
+  uint64_t func_hash;
+  uint64_t cfg_checksum;
+  const char* name;
+  uint32_t num_counters;
+  uint64_t* counters;
+};
+
+// Top-N value tables of the sites of one function and value kind.
+struct ValueRegion {
+  uint32_t kind;
+  uint64_t func_hash;
+  uint64_t cfg_checksum;
+  const char* name;
+  uint32_t num_sites;
+  const prof_value_site* sites;
+};
+
+// A function whose address may be an indirect call target.
+struct FunctionAddress {
+  const void* address;
+  uint64_t func_hash;
+  uint64_t cfg_checksum;
+  const char* name;
+};
+
+// Static costs of the blocks of one function, weighting its block counters.
+struct CostRegion {
+  uint64_t func_hash;
+  uint64_t cfg_checksum;
+  const char* name;
+  uint32_t num_blocks;
+  const uint64_t* counters;
+  const uint64_t* costs;
+};
+
+// Allocated on first use, registration runs from other constructors.
+static std::vector<CounterRegion>* regions;
+static std::vector<ValueRegion>* value_regions;
+static std::vector<FunctionAddress>* addresses;
+static std::vector<CostRegion>* cost_regions;
+
+// $LLVM_PASS_PROFILE, default llvm-pass.%p.prof, with %p replaced by the pid.
+static std::string profilePath() {
+  const char* env = getenv("LLVM_PASS_PROFILE");
+  std::string path = env != nullptr ? env : "llvm-pass.%p.prof";
+  size_t pos = path.find("%p");
+
+  if (pos != std::string::npos) {
+    path.replace(pos, 2, std::to_string(getpid()));
+  }
+  return path;
+}
+
+// Identifies a function of the profile.
+struct FunctionInfo {
+  uint64_t cfg_checksum;
+  const char* name;
+};
+
+// Prints the estimated cycles of the hottest functions, and of their
+// hottest blocks, to stderr. $LLVM_PASS_CYCLES_TOP sets how many functions
+// are listed (default 20, 0 for all).
+static void printCycles(const std::vector<prof_record>& records,
+                        const std::map<uint64_t, FunctionInfo>& funcs) {
+  const size_t kBlocksPerFunction = 5;
+  std::map<uint64_t, std::vector<const prof_record*>> blocks;
+  std::vector<std::pair<uint64_t, uint64_t>> totals;
+  uint64_t total = 0;
+
+  for (const prof_record& record : records) {
+    if (record.kind == PROF_CYCLES && record.count != 0) {
+      blocks[record.func_hash].push_back(&record);
+      total += record.count;
+    }
+  }
+  if (total == 0) {
+    return;
+  }
+
+  for (auto& func : blocks) {
+    uint64_t cycles = 0;
+    for (const prof_record* record : func.second) {
+      cycles += record->count;
+    }
+    totals.push_back(std::make_pair(cycles, func.first));
+    std::sort(func.second.begin(), func.second.end(),
+              [](const prof_record* a, const prof_record* b) {
+                return a->count > b->count;
+              });
+  }
+  std::sort(totals.begin(), totals.end(),
+            [](const std::pair<uint64_t, uint64_t>& a,
+               const std::pair<uint64_t, uint64_t>& b) {
+              return a.first > b.first;
+            });
+
+  const char* env = getenv("LLVM_PASS_CYCLES_TOP");
+  size_t n = env != nullptr ? strtoul(env, nullptr, 10) : 20;
+  if (n == 0 || n > totals.size()) {
+    n = totals.size();
+  }
+
+  fprintf(stderr, "estimated cycles: %llu\n", (unsigned long long) total);
+  for (size_t i = 0; i < n; ++i) {
+    const std::vector<const prof_record*>& func_blocks = blocks[totals[i].second];
+
+    fprintf(stderr, "%16llu %5.1f%%  %s\n", (unsigned long long) totals[i].first,
+            100.0 * totals[i].first / total, funcs.at(totals[i].second).name);
+    for (size_t b = 0; b < std::min(kBlocksPerFunction, func_blocks.size()); ++b) {
+      fprintf(stderr, "%16llu %5.1f%%    block %u\n",
+              (unsigned long long) func_blocks[b]->count,
+              100.0 * func_blocks[b]->count / total, func_blocks[b]->slot);
+    }
+  }
+}
+
+static void writeProfile() {
+  std::map<uint64_t, FunctionInfo> funcs;
+  std::map<const void*, uint64_t> hash_of;
+  std::vector<prof_record> records;
+
+  for (const CounterRegion& region : *regions) {
+    FunctionInfo info = {region.cfg_checksum, region.name};
+    funcs.insert(std::make_pair(region.func_hash, info));
+
+    for (uint32_t i = 0; i < region.num_counters; ++i) {
+      prof_record record = {region.func_hash, region.kind, region.site, i, 0, 0,
+                            region.counters[i]};
+      records.push_back(record);
+    }
+  }
+
+  for (const CostRegion& region : *cost_regions) {
+    FunctionInfo info = {region.cfg_checksum, region.name};
+    funcs.insert(std::make_pair(region.func_hash, info));
+
+    for (uint32_t i = 0; i < region.num_blocks; ++i) {
+      prof_record record = {region.func_hash, PROF_CYCLES, 0, i, 0, 0,
+                            region.counters[i] * region.costs[i]};
+      records.push_back(record);
+    }
+  }
+
+  for (const FunctionAddress& address : *addresses) {
+    FunctionInfo info = {address.cfg_checksum, address.name};
+    funcs.insert(std::make_pair(address.func_hash, info));
+    hash_of[address.address] = address.func_hash;
+  }
+
+  for (const ValueRegion& region : *value_regions) {
+    FunctionInfo info = {region.cfg_checksum, region.name};
+    funcs.insert(std::make_pair(region.func_hash, info));
+
+    for (uint32_t i = 0; i < region.num_sites; ++i) {
+      const prof_value_site& site = region.sites[i];
+      prof_record total = {region.func_hash, region.kind, i, PROF_VALUE_TOTAL, 0, 0,
+                           site.total};
+      records.push_back(total);
+
+      for (const prof_value_entry& entry : site.top) {
+        if (entry.count == 0) {
+          continue;
+        }
+
+        // Addresses differ between runs, so targets are stored as hashes.
+        uint64_t value = entry.value;
+        if (region.kind == PROF_INDIRECT_CALL) {
+          auto it = hash_of.find((const void*) value);
+          value = it != hash_of.end() ? it->second : 0;
+        }
+
+        prof_record record = {region.func_hash, region.kind, i, PROF_VALUE_COUNT, 0,
+                              value, entry.count};
+        records.push_back(record);
+      }
+    }
+  }
+  std::sort(records.begin(), records.end(), prof_record_less);
+
+  // Inline functions are instrumented in every module that emits them, so
+  // one function may have registered several arrays. Sum them.
+  size_t n = 0;
+  for (size_t i = 0; i < records.size(); ++i) {
+    if (n > 0 && !prof_record_less(records[n - 1], records[i])) {
+      records[n - 1].count += records[i].count;
+    } else {
+      records[n++] = records[i];
+    }
+  }
+  records.resize(n);
+  printCycles(records, funcs);
+
+  std::vector<prof_function> functions;
+  std::string names;
+
+  for (const auto& func : funcs) {
+    size_t len = strlen(func.second.name);
+    prof_function entry = {func.first, func.second.cfg_checksum, names.size(), len};
+
+    functions.push_back(entry);
+    names.append(func.second.name, len);
+  }
+
+  prof_header header;
+  memcpy(header.magic, PROF_MAGIC, 4);
+  header.version = PROF_VERSION;
+  header.num_functions = functions.size();
+  header.num_records = records.size();
+  header.names_size = names.size();
+
+  std::string path = profilePath();
+  FILE* file = fopen(path.c_str(), "wb");
+
+  if (file == nullptr) {
+    fprintf(stderr, "cannot write profile %s\n", path.c_str());
+    return;
+  }
+  fwrite(&header, sizeof(header), 1, file);
+  fwrite(functions.data(), sizeof(prof_function), functions.size(), file);
+  fwrite(records.data(), sizeof(prof_record), records.size(), file);
+  fwrite(names.data(), 1, names.size(), file);
+  fclose(file);
+}
+
+// Allocates the registries and arranges for the profile to be written,
+// on the first registration.
+static void initProfile() {
+  if (regions == nullptr) {
+    regions = new std::vector<CounterRegion>();
+    value_regions = new std::vector<ValueRegion>();
+    addresses = new std::vector<FunctionAddress>();
+    cost_regions = new std::vector<CostRegion>();
+    atexit(writeProfile);
+  }
+}
+
+// Registers <num_counters> counters of the function <name>, called from
+// module constructors emitted by the instrumentation passes.
+extern "C" __attribute__((visibility("default")))
+void registerProfileCounters(uint32_t kind, uint32_t site, uint64_t func_hash,
+                             uint64_t cfg_checksum, const char* name,
+                             uint32_t num_counters, uint64_t* counters) {
+  initProfile();
+
+  CounterRegion region = {kind, site, func_hash, cfg_checksum, name,
+                          num_counters, counters};
+  regions->push_back(region);
+}
+
+// Registers the static <costs> of the <num_blocks> blocks of the function
+// <name>, whose execution <counters> are registered as PROF_BLOCK. Their
+// products are written out as PROF_CYCLES.
+extern "C" __attribute__((visibility("default")))
+void registerBlockCosts(uint64_t func_hash, uint64_t cfg_checksum, const char* name,
+                        uint32_t num_blocks, const uint64_t* counters,
+                        const uint64_t* costs) {
+  initProfile();
+
+  CostRegion region = {func_hash, cfg_checksum, name, num_blocks, counters, costs};
+  cost_regions->push_back(region);
+}
+
+// Registers the value tables of the <num_sites> sites of <kind> in the
+// function <name>.
+extern "C" __attribute__((visibility("default")))
+void registerValueSites(uint32_t kind, uint64_t func_hash, uint64_t cfg_checksum,
+                        const char* name, uint32_t num_sites,
+                        const prof_value_site* sites) {
+  initProfile();
+
+  ValueRegion region = {kind, func_hash, cfg_checksum, name, num_sites, sites};
+  value_regions->push_back(region);
+}
+
+// Registers the function <name> at <address>, so that indirect calls to it
+// can be recorded by hash.
+extern "C" __attribute__((visibility("default")))
+void registerFunctionAddress(const void* address, uint64_t func_hash,
+                             uint64_t cfg_checksum, const char* name) {
+  initProfile();
+
+  FunctionAddress entry = {address, func_hash, cfg_checksum, name};
+  addresses->push_back(entry);
+}
+
+// Counts <value> at <site>. Called on the hot path, so it only scans the
+// few entries of the table.
+extern "C" __attribute__((visibility("default")))
+void profileValue(prof_value_site* site, uint64_t value) {
+  prof_value_entry* least = &site->top[0];
+
+  site->total += 1;
+  for (prof_value_entry& entry : site->top) {
+    if (entry.value == value) {
+      entry.count += 1;
+      return;
+    }
+    if (entry.count < least->count) {
+      least = &entry;
+    }
+  }
+
+  // Space-saving: the new value takes over the least frequent entry.
+  least->value = value;
+  least->count += 1;
+}
@@ -0,0 +1,237 @@
+#include "profile_format.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// Sampled memory access tracing. Instrumented code decrements a thread
+// local countdown on every load and store and calls traceMemoryAccess once
+// it drops below zero. A sample is a burst of consecutive accesses of one
+// thread, after which the countdown restarts at a random period.
+//
+// Every thread owns a ring buffer it alone writes to. A background thread
+// drains all rings into the trace file, so the instrumented threads never
+// lock or write files; if a ring is full, samples are dropped and counted.
+
+#define TRACE_RING_SIZE 16384
+
+struct TraceRing {
+  trace_entry entries[TRACE_RING_SIZE];
+  std::atomic<uint64_t> head;   // Next entry to write, owned by the thread.
+  std::atomic<uint64_t> tail;   // Next entry to drain, owned by the drainer.
+  std::atomic<uint64_t> dropped;
+  TraceRing* next;
+};
+
+struct TraceFunction {
+  uint64_t func_hash;
+  uint64_t cfg_checksum;
+  const char* name;
+  uint32_t num_sites;
+};
+
+// Checked and reset inline by the instrumented code.
+extern "C" {
+__attribute__((visibility("default"))) __thread int32_t __prof_trace_countdown;
+}
+
+static __thread TraceRing* thread_ring;
+static __thread uint32_t thread_id;
+static __thread uint32_t burst_left;
+static __thread uint32_t burst_id;
+static __thread uint64_t random_state;
+
+static std::atomic<TraceRing*> rings;
+static std::atomic<uint32_t> num_threads;
+static std::atomic<bool> stop_draining;
+
+static std::mutex functions_lock;
+static std::vector<TraceFunction>* functions;
+
+static FILE* trace_file;
+static std::thread* drainer;
+static uint32_t period = 100000;
+static uint32_t burst_length = 256;
+
+// $LLVM_PASS_TRACE, default llvm-pass.%p.trace, with %p replaced by the pid.
+static std::string tracePath() {
+  const char* env = getenv("LLVM_PASS_TRACE");
+  std::string path = env != nullptr ? env : "llvm-pass.%p.trace";
+  size_t pos = path.find("%p");
+
+  if (pos != std::string::npos) {
+    path.replace(pos, 2, std::to_string(getpid()));
+  }
+  return path;
+}
+
+static uint32_t envOr(const char* name, uint32_t value) {
+  const char* env = getenv(name);
+  return env != nullptr && atoi(env) > 0 ? atoi(env) : value;
+}
+
+// Writes the undrained entries of <ring>.
+static void drainRing(TraceRing* ring) {
+  uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+  uint64_t head = ring->head.load(std::memory_order_acquire);
+
+  while (tail != head) {
+    uint64_t begin = tail % TRACE_RING_SIZE;
+    uint64_t n = std::min<uint64_t>(head - tail, TRACE_RING_SIZE - begin);
+    trace_chunk chunk = {TRACE_ENTRIES, (uint32_t) n};
+
+    fwrite(&chunk, sizeof(chunk), 1, trace_file);
+    fwrite(&ring->entries[begin], sizeof(trace_entry), n, trace_file);
+    tail += n;
+  }
+  ring->tail.store(tail, std::memory_order_release);
+}
+
+static void drainAll() {
+  for (TraceRing* ring = rings.load(std::memory_order_acquire); ring != nullptr;
+       ring = ring->next) {
+    drainRing(ring);
+  }
+}
+
+static void drainLoop() {
+  while (!stop_draining.load(std::memory_order_relaxed)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    drainAll();
+  }
+}
+
+static void finishTrace() {
+  stop_draining.store(true, std::memory_order_relaxed);
+  drainer->join();
+  drainAll();
+
+  uint64_t dropped = 0;
+  for (TraceRing* ring = rings.load(std::memory_order_acquire); ring != nullptr;
+       ring = ring->next) {
+    dropped += ring->dropped.load(std::memory_order_relaxed);
+  }
+  trace_chunk dropped_chunk = {TRACE_DROPPED, 0};
+  fwrite(&dropped_chunk, sizeof(dropped_chunk), 1, trace_file);
+  fwrite(&dropped, sizeof(dropped), 1, trace_file);
+
+  std::lock_guard<std::mutex> lock(functions_lock);
+  std::vector<trace_function> entries;
+  std::string names;
+
+  for (const TraceFunction& func : *functions) {
+    size_t len = strlen(func.name);
+    trace_function entry = {func.func_hash, func.cfg_checksum, names.size(), len,
+                            func.num_sites};
+    entries.push_back(entry);
+    names.append(func.name, len);
+  }
+
+  trace_chunk functions_chunk = {TRACE_FUNCTIONS, (uint32_t) entries.size()};
+  uint64_t names_size = names.size();
+  fwrite(&functions_chunk, sizeof(functions_chunk), 1, trace_file);
+  fwrite(entries.data(), sizeof(trace_function), entries.size(), trace_file);
+  fwrite(&names_size, sizeof(names_size), 1, trace_file);
+  fwrite(names.data(), 1, names.size(), trace_file);
+  fclose(trace_file);
+}
+
+// Opens the trace and starts the drainer, on the first registration.
+static void initTrace() {
+  if (functions != nullptr) {
+    return;
+  }
+  functions = new std::vector<TraceFunction>();
+  period = envOr("LLVM_PASS_TRACE_PERIOD", period);
+  burst_length = envOr("LLVM_PASS_TRACE_BURST", burst_length);
+
+  std::string path = tracePath();
+  trace_file = fopen(path.c_str(), "wb");
+  if (trace_file == nullptr) {
+    fprintf(stderr, "cannot write trace %s\n", path.c_str());
+    abort();
+  }
+
+  trace_header header;
+  memcpy(header.magic, TRACE_MAGIC, 4);
+  header.version = TRACE_VERSION;
+  fwrite(&header, sizeof(header), 1, trace_file);
+
+  drainer = new std::thread(drainLoop);
+  atexit(finishTrace);
+}
+
+// Countdown to the next burst, uniform in [period / 2, period * 3 / 2) so
+// that bursts do not lock onto the period of a loop.
+static int32_t nextCountdown() {
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 7;
+  random_state ^= random_state << 17;
+  return period / 2 + random_state % period;
+}
+
+static TraceRing* createRing() {
+  TraceRing* ring = new TraceRing();
+  ring->head.store(0, std::memory_order_relaxed);
+  ring->tail.store(0, std::memory_order_relaxed);
+  ring->dropped.store(0, std::memory_order_relaxed);
+
+  // Rings are pushed onto a lock-free list and never freed, the drainer
+  // may still be reading them after their thread exited.
+  TraceRing* head = rings.load(std::memory_order_relaxed);
+  do {
+    ring->next = head;
+  } while (!rings.compare_exchange_weak(head, ring, std::memory_order_release,
+                                        std::memory_order_relaxed));
+
+  thread_id = num_threads.fetch_add(1, std::memory_order_relaxed);
+  random_state = 0x9e3779b97f4a7c15ULL * (thread_id + 1);
+  return ring;
+}
+
+// Registers the function <name> with <num_sites> traced accesses.
+extern "C" __attribute__((visibility("default")))
+void registerTraceFunction(uint64_t func_hash, uint64_t cfg_checksum,
+                           const char* name, uint32_t num_sites) {
+  std::lock_guard<std::mutex> lock(functions_lock);
+  initTrace();
+
+  TraceFunction func = {func_hash, cfg_checksum, name, num_sites};
+  functions->push_back(func);
+}
+
+// Records the access of <info> (see trace_entry) to <address> by <site>.
+extern "C" __attribute__((visibility("default")))
+void traceMemoryAccess(uint64_t func_hash, uint32_t site, uint32_t info,
+                       const void* address) {
+  if (thread_ring == nullptr) {
+    thread_ring = createRing();
+  }
+  if (burst_left == 0) {
+    burst_left = burst_length;
+    burst_id += 1;
+  }
+
+  TraceRing* ring = thread_ring;
+  uint64_t head = ring->head.load(std::memory_order_relaxed);
+
+  if (head - ring->tail.load(std::memory_order_acquire) == TRACE_RING_SIZE) {
+    ring->dropped.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    trace_entry entry = {func_hash, site, info, (uint64_t) address, thread_id, burst_id};
+    ring->entries[head % TRACE_RING_SIZE] = entry;
+    ring->head.store(head + 1, std::memory_order_release);
+  }
+
+  // Within a burst every access calls in again.
+  burst_left -= 1;
+  __prof_trace_countdown = burst_left > 0 ? 0 : nextCountdown();
+}
@@ -0,0 +1,209 @@
+#ifndef LLVM_PASS_PROFILE_FORMAT_H
+#define LLVM_PASS_PROFILE_FORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Binary profile written by the runtime in lib/ and read by the profile
+// guided passes and the tools. Layout, in host byte order:
+//
+//   prof_header
+//   prof_function[num_functions]   sorted by hash
+//   prof_record[num_records]       sorted by (func_hash, kind, site, slot, value)
+//   char names[names_size]         function names, not NUL terminated
+//
+// Everything is fixed size and sorted, so readers can mmap a file and
+// binary search it without parsing.
+
+#define PROF_MAGIC "LPPF"
+#define PROF_VERSION 2
+
+enum prof_kind {
+  PROF_BLOCK = 1,         // Executions of block <slot>; <site> is 0.
+  PROF_DIVISOR = 2,       // Divisors of division or remainder <site>.
+  PROF_INDIRECT_CALL = 3, // Targets of indirect call <site>, as function
+                          // hashes, 0 for targets outside the profile.
+  PROF_LOOP_TRIPS = 4,    // Entries into the loop headed by block <site>
+                          // that ran the header 2^slot .. 2^(slot+1)-1 times.
+  PROF_CYCLES = 5,        // Estimated cycles spent in block <slot>: its
+                          // executions times the cost of its instructions.
+  PROF_SAMPLES = 6,       // PC samples that landed in block <slot>; <site>
+                          // is 0.
+  PROF_SWITCH = 7,        // Times the switch ending block <site> went to
+                          // successor <slot>: 0 is the default, i case i-1.
+  PROF_CALL = 8,          // Executions of direct call <slot>, calls numbered
+                          // in instruction order; <site> is 0.
+};
+
+// Buckets of a PROF_LOOP_TRIPS histogram, one per power of two.
+#define PROF_TRIP_BUCKETS 64
+
+// Slots of the value kinds: how often <site> saw <value>, and how often it
+// ran at all (with value 0).
+enum prof_value_slot {
+  PROF_VALUE_COUNT = 0,
+  PROF_VALUE_TOTAL = 1,
+};
+
+struct prof_header {
+  char magic[4];
+  uint32_t version;
+  uint64_t num_functions;
+  uint64_t num_records;
+  uint64_t names_size;
+};
+
+struct prof_function {
+  uint64_t hash;          // prof_hash() of the profile name.
+  uint64_t cfg_checksum;  // Shape of the CFG the counters were laid out for.
+  uint64_t name_offset;   // Into names.
+  uint64_t name_size;
+};
+
+struct prof_record {
+  uint64_t func_hash;
+  uint32_t kind;
+  uint32_t site;
+  uint32_t slot;
+  uint32_t reserved;
+  uint64_t value;         // Profiled value of the value kinds, else 0.
+  uint64_t count;
+};
+
+// In-memory table of the most frequent values of one site, filled by the
+// runtime with the space-saving algorithm: a value not in the table takes
+// over the least frequent entry and its count plus one, so the counts are
+// upper bounds and any value seen more than total / N times is kept.
+#define PROF_VALUE_TOP_N 4
+
+struct prof_value_entry {
+  uint64_t value;
+  uint64_t count;
+};
+
+struct prof_value_site {
+  uint64_t total;
+  prof_value_entry top[PROF_VALUE_TOP_N];
+};
+
+// Coverage bitmap written by lib/lib_cov.cc: one bit per basic block, set
+// if the block ran at all. Layout, in host byte order:
+//
+//   cov_header
+//   cov_function[num_functions]    sorted by hash
+//   uint8_t bitmap[bitmap_size]    bit b is bitmap[b / 8] >> (b % 8) & 1
+//   char names[names_size]
+//
+// The blocks of a function are bits first_bit .. first_bit + num_blocks - 1.
+
+#define COV_MAGIC "LPCV"
+#define COV_VERSION 1
+
+struct cov_header {
+  char magic[4];
+  uint32_t version;
+  uint64_t num_functions;
+  uint64_t bitmap_size;
+  uint64_t names_size;
+};
+
+struct cov_function {
+  uint64_t hash;
+  uint64_t cfg_checksum;
+  uint64_t name_offset;
+  uint64_t name_size;
+  uint64_t first_bit;
+  uint64_t num_blocks;
+};
+
+// Sampled memory access trace written by lib/lib_trace.cc: a trace_header
+// followed by chunks, each a trace_chunk and its payload:
+//
+//   TRACE_ENTRIES     trace_entry[count], in access order per thread
+//   TRACE_FUNCTIONS   trace_function[count], uint64_t names_size, names
+//   TRACE_DROPPED     uint64_t samples lost to full buffers
+//
+// Accesses are sampled in bursts of consecutive accesses of one thread, so
+// strides and reuse distances can be measured within a burst.
+
+#define TRACE_MAGIC "LPMT"
+#define TRACE_VERSION 1
+
+enum trace_chunk_type {
+  TRACE_ENTRIES = 1,
+  TRACE_FUNCTIONS = 2,
+  TRACE_DROPPED = 3,
+};
+
+struct trace_header {
+  char magic[4];
+  uint32_t version;
+};
+
+struct trace_chunk {
+  uint32_t type;
+  uint32_t count;
+};
+
+// trace_entry.info is the access size in bytes shifted left by one, or'ed
+// with TRACE_STORE for stores.
+#define TRACE_STORE 1
+
+struct trace_entry {
+  uint64_t func_hash;
+  uint32_t site;          // Load or store <site> of the function, in
+                          // instruction order.
+  uint32_t info;
+  uint64_t address;
+  uint32_t thread;
+  uint32_t burst;
+};
+
+struct trace_function {
+  uint64_t hash;
+  uint64_t cfg_checksum;
+  uint64_t name_offset;
+  uint64_t name_size;
+  uint64_t num_sites;
+};
+
+static inline bool trace_header_valid(const trace_header* header) {
+  return memcmp(header->magic, TRACE_MAGIC, 4) == 0 &&
+         header->version == TRACE_VERSION;
+}
+
+// 64-bit FNV-1a of a function's profile name.
+static inline uint64_t prof_hash(const char* s, size_t n) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+
+  for (size_t i = 0; i < n; ++i) {
+    hash ^= (uint8_t) s[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+static inline bool prof_record_less(const prof_record& a, const prof_record& b) {
+  if (a.func_hash != b.func_hash) return a.func_hash < b.func_hash;
+  if (a.kind != b.kind) return a.kind < b.kind;
+  if (a.site != b.site) return a.site < b.site;
+  if (a.slot != b.slot) return a.slot < b.slot;
+  return a.value < b.value;
+}
+
+static inline bool prof_header_valid(const prof_header* header) {
+  return memcmp(header->magic, PROF_MAGIC, 4) == 0 &&
+         header->version == PROF_VERSION;
+}
+
+static inline bool cov_header_valid(const cov_header* header) {
+  return memcmp(header->magic, COV_MAGIC, 4) == 0 &&
+         header->version == COV_VERSION;
+}
+
+static inline bool cov_bit(const uint8_t* bitmap, uint64_t bit) {
+  return (bitmap[bit / 8] >> (bit % 8)) & 1;
+}
+
+#endif
@@ -0,0 +1,219 @@
+#include "AnalysisCache.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+static cl::opt<std::string> dfa_cache_dir(
+    "dfa-cache-dir",
+    cl::desc("Cache dataflow analysis results in <directory> across runs"),
+    cl::value_desc("directory"), cl::init(""));
+
+static const char kCacheMagic[4] = {'D', 'F', 'A', 'C'};
+
+namespace {
+
+// 64-bit FNV-1a, chosen over hash_code because it must not change between
+// runs of the tool.
+class StableHasher {
+ public:
+  StableHasher() : hash_(0xcbf29ce484222325ULL) { }
+
+  void add(uint64_t x) {
+    for (int i = 0; i < 8; ++i) {
+      addByte((uint8_t) (x >> (i * 8)));
+    }
+  }
+
+  void add(StringRef s) {
+    add(s.size());
+    for (char c : s) {
+      addByte((uint8_t) c);
+    }
+  }
+
+  uint64_t hash() const {
+    return hash_;
+  }
+
+ private:
+  void addByte(uint8_t byte) {
+    hash_ ^= byte;
+    hash_ *= 0x100000001b3ULL;
+  }
+
+  uint64_t hash_;
+};
+
+class FunctionHasher {
+ public:
+  explicit FunctionHasher(const Function& F) : F_(F) { }
+
+  uint64_t run() {
+    int i = 0;
+    for (const BasicBlock& block : F_) {
+      block_index_[&block] = i++;
+    }
+    i = 0;
+    for (const BasicBlock& block : F_) {
+      for (const Instruction& inst : block) {
+        inst_index_[&inst] = i++;
+      }
+    }
+
+    hasher_.add(F_.arg_size());
+    for (const Argument& arg : F_.args()) {
+      addType(arg.getType());
+    }
+
+    for (const BasicBlock& block : F_) {
+      hasher_.add(block.size());
+      for (const Instruction& inst : block) {
+        addInstruction(inst);
+      }
+    }
+    return hasher_.hash();
+  }
+
+ private:
+  void addType(Type* type) {
+    DenseMap<Type*, uint64_t>::iterator it = type_hash_.find(type);
+    if (it == type_hash_.end()) {
+      std::string str;
+      raw_string_ostream os(str);
+      type->print(os);
+
+      StableHasher hasher;
+      hasher.add(os.str());
+      it = type_hash_.insert(std::make_pair(type, hasher.hash())).first;
+    }
+    hasher_.add(it->second);
+  }
+
+  void addOperand(const Value* value) {
+    if (const Instruction* inst = dyn_cast<Instruction>(value)) {
+      hasher_.add(1);
+      hasher_.add(inst_index_.lookup(inst));
+    } else if (const Argument* arg = dyn_cast<Argument>(value)) {
+      hasher_.add(2);
+      hasher_.add(arg->getArgNo());
+    } else if (const BasicBlock* block = dyn_cast<BasicBlock>(value)) {
+      hasher_.add(3);
+      hasher_.add(block_index_.lookup(block));
+    } else if (const ConstantInt* ci = dyn_cast<ConstantInt>(value)) {
+      hasher_.add(4);
+      addType(ci->getType());
+      const APInt& bits = ci->getValue();
+      for (unsigned i = 0; i < bits.getNumWords(); ++i) {
+        hasher_.add(bits.getRawData()[i]);
+      }
+    } else if (const GlobalValue* gv = dyn_cast<GlobalValue>(value)) {
+      hasher_.add(5);
+      hasher_.add(gv->getName());
+    } else {
+      // Remaining constants, inline asm and metadata are rare enough to be
+      // hashed by their printed form.
+      std::string str;
+      raw_string_ostream os(str);
+      value->print(os);
+      hasher_.add(6);
+      hasher_.add(os.str());
+    }
+  }
+
+  void addInstruction(const Instruction& inst) {
+    hasher_.add(inst.getOpcode());
+    addType(inst.getType());
+    hasher_.add(inst.getNumOperands());
+    for (const Use& op : inst.operands()) {
+      addOperand(op.get());
+    }
+
+    if (const CmpInst* cmp = dyn_cast<CmpInst>(&inst)) {
+      hasher_.add(cmp->getPredicate());
+    } else if (const PHINode* phi = dyn_cast<PHINode>(&inst)) {
+      for (auto blk_it = phi->block_begin(); blk_it != phi->block_end(); ++blk_it) {
+        hasher_.add(block_index_.lookup(*blk_it));
+      }
+    } else if (const AllocaInst* alloca = dyn_cast<AllocaInst>(&inst)) {
+      addType(alloca->getAllocatedType());
+    } else if (const GetElementPtrInst* gep = dyn_cast<GetElementPtrInst>(&inst)) {
+      addType(gep->getSourceElementType());
+    }
+  }
+
+  const Function& F_;
+  StableHasher hasher_;
+  DenseMap<const BasicBlock*, uint64_t> block_index_;
+  DenseMap<const Instruction*, uint64_t> inst_index_;
+  DenseMap<Type*, uint64_t> type_hash_;
+};
+
+}  /* namespace */
+
+static std::string GetCachePath(StringRef analysis, unsigned version, uint64_t hash) {
+  SmallString<128> path(dfa_cache_dir);
+  sys::path::append(path, analysis + "-v" + utostr(version) + "-" +
+                    utohexstr(hash) + ".dfa");
+  return path.str().str();
+}
+
+StringRef llvm::GetAnalysisCacheDir() {
+  return dfa_cache_dir;
+}
+
+uint64_t llvm::HashFunctionStructure(const Function& F) {
+  return FunctionHasher(F).run();
+}
+
+bool llvm::ReadAnalysisCache(StringRef analysis, unsigned version, uint64_t hash,
+                             std::string& data) {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> buffer =
+      MemoryBuffer::getFile(GetCachePath(analysis, version, hash));
+
+  if (!buffer) {
+    return false;
+  }
+
+  StringRef contents = (*buffer)->getBuffer();
+  if (!contents.startswith(StringRef(kCacheMagic, sizeof(kCacheMagic)))) {
+    return false;
+  }
+  data = contents.drop_front(sizeof(kCacheMagic)).str();
+  return true;
+}
+
+void llvm::WriteAnalysisCache(StringRef analysis, unsigned version, uint64_t hash,
+                              StringRef data) {
+  if (sys::fs::create_directories(dfa_cache_dir)) {
+    return;
+  }
+
+  // Write to a private file first so that concurrent runs never observe a
+  // partially written entry.
+  SmallString<128> model(dfa_cache_dir);
+  SmallString<128> tmp_path;
+  int fd;
+
+  sys::path::append(model, "tmp-%%%%%%%%.dfa");
+  if (sys::fs::createUniqueFile(model, fd, tmp_path)) {
+    return;
+  }
+  {
+    raw_fd_ostream os(fd, true /* shouldClose */);
+    os.write(kCacheMagic, sizeof(kCacheMagic));
+    os << data;
+  }
+  if (sys::fs::rename(tmp_path, GetCachePath(analysis, version, hash))) {
+    sys::fs::remove(tmp_path);
+  }
+}
@@ -0,0 +1,53 @@
+#ifndef LLVM_ANALYSIS_CACHE_H
+#define LLVM_ANALYSIS_CACHE_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/Function.h"
+
+#include <stdint.h>
+#include <string>
+
+namespace llvm {
+
+// Directory given by -dfa-cache-dir, empty if caching is disabled.
+StringRef GetAnalysisCacheDir();
+
+// Hash of the structure of <F>: its instructions, operands, types and CFG.
+// Names are ignored, so structurally identical functions share a hash. The
+// hash is stable across runs and hosts.
+uint64_t HashFunctionStructure(const Function& F);
+
+// Loads the cached result of <analysis> at <version> for a function with
+// structural hash <hash> into <data>. Returns false on a miss.
+bool ReadAnalysisCache(StringRef analysis, unsigned version, uint64_t hash,
+                       std::string& data);
+
+// Stores <data> as the result of <analysis> at <version> for <hash>. Errors
+// are ignored, the cache is only an accelerator.
+void WriteAnalysisCache(StringRef analysis, unsigned version, uint64_t hash,
+                        StringRef data);
+
+// LEB128 encoding used by the serialized analysis results.
+inline void WriteVarint(std::string& out, uint64_t x) {
+  while (x >= 0x80) {
+    out.push_back((char) ((x & 0x7f) | 0x80));
+    x >>= 7;
+  }
+  out.push_back((char) x);
+}
+
+inline bool ReadVarint(const char*& p, const char* end, uint64_t& x) {
+  x = 0;
+  for (unsigned shift = 0; p != end && shift < 64; shift += 7) {
+    uint8_t byte = (uint8_t) *p++;
+    x |= (uint64_t) (byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}
+
+#endif
@@ -0,0 +1,225 @@
+#include "ProfileUse.h"
+#include "llvm/Pass.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/MDBuilder.h"
+
+#include <algorithm>
+#include <vector>
+
+using namespace llvm;
+
+namespace {
+
+// Lays out the blocks of each function by the block counts of
+// -profile-use (PROF_BLOCK, or PROF_SAMPLES if the function has no block
+// counts), with the bottom-up chain merging of Pettis and Hansen: every
+// block starts as a chain of its own, and going through the CFG edges from
+// the heaviest down, an edge joins two chains if it leads from the tail of
+// one to the head of the other. The chains are then placed entry first,
+// the others by their hottest block, and chains that never ran last.
+//
+// The profile counts blocks, not edges, so edge counts are inferred from
+// flow conservation where it decides them. Conditional branches get them
+// as branch weights too, so the block placement of the code generator
+// keeps the hot paths falling through. PC samples measure the time spent
+// in a block rather than how often it runs, so they only order the chains
+// and give no branch weights.
+//
+// The counts are read as the profile guided passes attach them (see
+// ProfileUse.h), so the layout also applies to functions that earlier of
+// them changed. Blocks without a count count as never run.
+struct BlockLayoutPass : public FunctionPass {
+  static char ID;
+  BlockLayoutPass() : FunctionPass(ID) { }
+
+  struct Edge {
+    BasicBlock* from;
+    BasicBlock* to;
+    uint64_t weight;
+    bool known;
+  };
+
+  // Infers the counts of the edges of <F> from <count>: whenever all edges
+  // but one into or out of a block are known, the last one makes up the
+  // difference. Edges left undecided get the smaller count of their ends,
+  // and so do all edges unless <count> holds <executions>.
+  static std::vector<Edge> InferEdges(Function& F, DenseMap<BasicBlock*, uint64_t>& count,
+                                      bool executions) {
+    std::vector<Edge> edges;
+    DenseMap<BasicBlock*, std::vector<size_t>> in, out;
+
+    for (BasicBlock& block : F) {
+      SmallPtrSet<BasicBlock*, 8> seen;
+      for (succ_iterator succ_it = succ_begin(&block), succ_e = succ_end(&block);
+           succ_it != succ_e; ++succ_it) {
+        if (seen.insert(*succ_it).second) {
+          out[&block].push_back(edges.size());
+          in[*succ_it].push_back(edges.size());
+          edges.push_back(Edge{&block, *succ_it, 0, false});
+        }
+      }
+    }
+
+    // Solves the one unknown edge of <ids>, if there is exactly one.
+    auto solve = [&edges](uint64_t total, const std::vector<size_t>& ids) {
+      uint64_t known = 0;
+      size_t unknown = ids.size();
+      for (size_t id : ids) {
+        if (edges[id].known) {
+          known += edges[id].weight;
+        } else if (unknown != ids.size()) {
+          return false;
+        } else {
+          unknown = id;
+        }
+      }
+      if (unknown == ids.size()) {
+        return false;
+      }
+      edges[unknown].weight = total > known ? total - known : 0;
+      edges[unknown].known = true;
+      return true;
+    };
+
+    for (bool changed = executions; changed; ) {
+      changed = false;
+      for (BasicBlock& block : F) {
+        // The entry is also entered from outside, so only its successors
+        // balance.
+        if (&block != &F.getEntryBlock()) {
+          changed |= solve(count[&block], in[&block]);
+        }
+        changed |= solve(count[&block], out[&block]);
+      }
+    }
+
+    for (Edge& edge : edges) {
+      if (!edge.known) {
+        edge.weight = std::min(count[edge.from], count[edge.to]);
+      }
+    }
+    return edges;
+  }
+
+  // Attaches the inferred counts of <edges> to conditional branches that
+  // have no weights yet.
+  static bool SetBranchWeights(const std::vector<Edge>& edges) {
+    DenseMap<std::pair<BasicBlock*, BasicBlock*>, const Edge*> edge_of;
+    for (const Edge& edge : edges) {
+      edge_of[std::make_pair(edge.from, edge.to)] = &edge;
+    }
+
+    bool changed = false;
+    for (const Edge& edge : edges) {
+      BranchInst* br = dyn_cast<BranchInst>(edge.from->getTerminator());
+      if (br == nullptr || !br->isConditional() || br->getSuccessor(0) != edge.to ||
+          br->getSuccessor(1) == edge.to || br->getMetadata(LLVMContext::MD_prof) != nullptr) {
+        continue;
+      }
+
+      const Edge* other = edge_of.lookup(std::make_pair(edge.from, br->getSuccessor(1)));
+      if (!edge.known || !other->known || edge.weight + other->weight == 0) {
+        continue;
+      }
+
+      uint64_t scale = std::max(edge.weight, other->weight) / UINT32_MAX + 1;
+      br->setMetadata(LLVMContext::MD_prof,
+                      MDBuilder(br->getContext()).createBranchWeights(
+                          edge.weight / scale, other->weight / scale));
+      changed = true;
+    }
+    return changed;
+  }
+
+  bool runOnFunction(Function& F) override {
+    if (UsedProfile() == nullptr || F.isDeclaration()) {
+      return false;
+    }
+    bool changed = AttachProfileCounts(F);
+
+    DenseMap<BasicBlock*, uint64_t> count;
+    bool executions = GetBlockCounts(F, PROF_BLOCK, count);
+    if (!executions && !GetBlockCounts(F, PROF_SAMPLES, count)) {
+      return changed;
+    }
+
+    std::vector<BasicBlock*> blocks;
+    for (BasicBlock& block : F) {
+      blocks.push_back(&block);
+    }
+
+    std::vector<Edge> edges = InferEdges(F, count, executions);
+    changed |= executions && SetBranchWeights(edges);
+
+    std::vector<std::vector<BasicBlock*>> chains;
+    DenseMap<BasicBlock*, size_t> chain_of;
+    for (BasicBlock* block : blocks) {
+      chain_of[block] = chains.size();
+      chains.push_back(std::vector<BasicBlock*>(1, block));
+    }
+
+    std::stable_sort(edges.begin(), edges.end(),
+                     [](const Edge& a, const Edge& b) {
+                       return a.weight > b.weight;
+                     });
+    for (const Edge& edge : edges) {
+      size_t from = chain_of[edge.from];
+      size_t to = chain_of[edge.to];
+      if (edge.weight == 0 || from == to || chains[from].back() != edge.from ||
+          chains[to].front() != edge.to || edge.to == &F.getEntryBlock()) {
+        continue;
+      }
+
+      for (BasicBlock* block : chains[to]) {
+        chain_of[block] = from;
+        chains[from].push_back(block);
+      }
+      chains[to].clear();
+    }
+
+    // The entry's chain first, then by the count of their hottest block.
+    // The sort is stable, so the cold chains keep their original order.
+    std::vector<std::pair<uint64_t, size_t>> order;
+    for (size_t c = 0; c < chains.size(); ++c) {
+      if (chains[c].empty()) {
+        continue;
+      }
+      uint64_t heat = 0;
+      for (BasicBlock* block : chains[c]) {
+        heat = std::max(heat, count[block]);
+      }
+      order.push_back(std::make_pair(c == chain_of[&F.getEntryBlock()] ? UINT64_MAX : heat, c));
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [](const std::pair<uint64_t, size_t>& a,
+                        const std::pair<uint64_t, size_t>& b) {
+                       return a.first > b.first;
+                     });
+
+    BasicBlock* prev = nullptr;
+    for (const auto& chain : order) {
+      for (BasicBlock* block : chains[chain.second]) {
+        if (prev != nullptr && block->getPrevNode() != prev) {
+          block->moveAfter(prev);
+          changed = true;
+        }
+        prev = block;
+      }
+    }
+    return changed;
+  }
+};
+
+}
+
+char BlockLayoutPass::ID = 0;
+static RegisterPass<BlockLayoutPass> X(
+    "block-layout", "Lay out blocks by profile",
+    false /* Only looks at CFG */,
+    false /* Analysis Pass */);
@@ -1,18 +1,47 @@
+#include "CounterPromotion.h"
+#include "Instrumentation.h"
 #include "llvm/Pass.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
 #include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Dominators.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/GlobalVariable.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/InstIterator.h"
 #include "llvm/IR/Instruction.h"
 #include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
 
 #include <map>
+#include <memory>
 #include <vector>
 
 using namespace llvm;
 
+static cl::opt<bool> count_blocks(
+    "cdi-blocks",
+    cl::desc("Count executions of each basic block into a binary profile "
+             "(see lib/lib_prof.cc) instead of instructions by opcode"),
+    cl::init(false));
+
+static cl::opt<bool> cover_blocks(
+    "cdi-coverage",
+    cl::desc("Only record whether each basic block ran, as one byte per block "
+             "written out as a bitmap (see lib/lib_cov.cc); overrides "
+             "-cdi-blocks"),
+    cl::init(false));
+
+static cl::opt<bool> cost_blocks(
+    "cdi-cost",
+    cl::desc("Weight the block counts of -cdi-blocks by the cost of each "
+             "block from TargetTransformInfo, writing estimated cycles per "
+             "block to the profile and reporting them at exit; implies "
+             "-cdi-blocks"),
+    cl::init(false));
+
 namespace {
 
 struct CountDIPass : public FunctionPass {
@@ -23,6 +52,128 @@ struct CountDIPass : public FunctionPass {
     return ConstantInt::get(ctx, APInt(32 /* nbits */, n, false /* is_signed */));
   }
 
+  static bool CountsBlocks() {
+    return (count_blocks || cost_blocks) && !cover_blocks;
+  }
+
+  void getAnalysisUsage(AnalysisUsage& AU) const override {
+    if (CountsBlocks() && CounterPromotionEnabled()) {
+      AU.addRequired<DominatorTreeWrapperPass>();
+      AU.addRequired<LoopInfoWrapperPass>();
+      AU.addRequired<ScalarEvolutionWrapperPass>();
+    }
+    if (CountsBlocks() && cost_blocks) {
+      AU.addRequired<TargetTransformInfoWrapperPass>();
+    }
+  }
+
+  // Estimated cycles <inst> takes, as priced by the target for the loop
+  // vectorizer: arithmetic, memory accesses, casts and compares by their
+  // reciprocal throughput, anything else by its user cost (free for phis
+  // and no-op casts, expensive for calls).
+  static uint64_t InstructionCycles(const TargetTransformInfo& TTI, Instruction& inst) {
+    unsigned opcode = inst.getOpcode();
+    int cost;
+
+    if (isa<BinaryOperator>(inst)) {
+      TargetTransformInfo::OperandValueKind rhs_kind = isa<Constant>(inst.getOperand(1)) ?
+          TargetTransformInfo::OK_UniformConstantValue : TargetTransformInfo::OK_AnyValue;
+      cost = TTI.getArithmeticInstrCost(opcode, inst.getType(),
+                                        TargetTransformInfo::OK_AnyValue, rhs_kind);
+    } else if (LoadInst* load = dyn_cast<LoadInst>(&inst)) {
+      cost = TTI.getMemoryOpCost(opcode, load->getType(), load->getAlignment(),
+                                 load->getPointerAddressSpace());
+    } else if (StoreInst* store = dyn_cast<StoreInst>(&inst)) {
+      cost = TTI.getMemoryOpCost(opcode, store->getValueOperand()->getType(),
+                                 store->getAlignment(), store->getPointerAddressSpace());
+    } else if (isa<CastInst>(inst)) {
+      cost = TTI.getCastInstrCost(opcode, inst.getType(), inst.getOperand(0)->getType());
+    } else if (isa<CmpInst>(inst)) {
+      cost = TTI.getCmpSelInstrCost(opcode, inst.getOperand(0)->getType());
+    } else if (isa<SelectInst>(inst)) {
+      cost = TTI.getCmpSelInstrCost(opcode, inst.getType(), inst.getOperand(0)->getType());
+    } else {
+      cost = TTI.getUserCost(&inst);
+    }
+    return cost > 0 ? cost : 0;
+  }
+
+  // Gives every block a counter, or with -cdi-coverage a flag, indexed by
+  // the position of the block in the function, which is the block id used
+  // by the profile. With -promote-counters, counters inside loops are kept
+  // in registers, or derived from the trip count where it decides them.
+  bool InstrumentBlocks(Function& F) {
+    std::vector<BasicBlock*> blocks;
+
+    for (Function::iterator blk_it = F.begin(), blk_e = F.end();
+         blk_it != blk_e; ++blk_it) {
+      blocks.push_back(&*blk_it);
+    }
+
+    GlobalVariable* slots = cover_blocks ?
+        CreateFlagArray(F, "cov", blocks.size()) :
+        CreateCounterArray(F, "blocks", blocks.size());
+
+    // Priced before the counters are added to the blocks.
+    GlobalVariable* costs = nullptr;
+    if (!cover_blocks && cost_blocks) {
+      const TargetTransformInfo& TTI =
+          getAnalysis<TargetTransformInfoWrapperPass>().getTTI(F);
+      std::vector<uint64_t> block_costs;
+
+      for (BasicBlock* block : blocks) {
+        uint64_t cost = 0;
+        for (Instruction& inst : *block) {
+          cost += InstructionCycles(TTI, inst);
+        }
+        block_costs.push_back(cost);
+      }
+      costs = CreateCostArray(F, block_costs);
+    }
+
+    std::unique_ptr<CounterPromoter> promoter;
+    ScalarEvolution* SE = nullptr;
+    if (!cover_blocks && CounterPromotionEnabled()) {
+      promoter.reset(new CounterPromoter(
+          F, getAnalysis<LoopInfoWrapperPass>().getLoopInfo(),
+          getAnalysis<DominatorTreeWrapperPass>().getDomTree(),
+          [slots](IRBuilder<>& builder, uint64_t index, Value* count) {
+            EmitCounterAdd(builder, slots, index, count);
+          }));
+      SE = &getAnalysis<ScalarEvolutionWrapperPass>().getSE();
+    }
+
+    for (size_t i = 0; i < blocks.size(); ++i) {
+      BasicBlock::iterator insert_pt = blocks[i]->getFirstInsertionPt();
+
+      // Blocks without an insertion point (catchswitch) stay uncounted.
+      if (insert_pt != blocks[i]->end()) {
+        IRBuilder<> builder(&*insert_pt);
+        if (cover_blocks) {
+          EmitFlagSet(builder, slots, i);
+        } else if (promoter == nullptr ||
+                   !(promoter->AddIterations(blocks[i], i, *SE) ||
+                     promoter->Add(&*insert_pt, i, builder.getInt64(1)))) {
+          EmitCounterIncrement(builder, slots, i);
+        }
+      }
+    }
+
+    if (promoter != nullptr) {
+      promoter->Finish();
+    }
+
+    if (cover_blocks) {
+      EmitFlagRegistration(F, slots);
+    } else {
+      EmitCounterRegistration(F, PROF_BLOCK, 0 /* site */, slots);
+    }
+    if (costs != nullptr) {
+      EmitCostRegistration(F, slots, costs);
+    }
+    return true;
+  }
+
   bool runOnFunction(Function& F) override {
     Module* mod = F.getParent();
 
@@ -30,6 +181,13 @@ struct CountDIPass : public FunctionPass {
       return false;
     }
 
+    if (count_blocks || cost_blocks || cover_blocks) {
+      if (F.isDeclaration() || IsProfileHelper(F)) {
+        return false;
+      }
+      return InstrumentBlocks(F);
+    }
+
     LLVMContext& ctx = mod->getContext();
     Function* updateF = nullptr;
     Function* printF = nullptr;
@@ -1,11 +1,10 @@
+#include "CountStaticInst.h"
+#include "ResultStream.h"
 #include "llvm/Pass.h"
 #include "llvm/IR/Function.h"
-#include "llvm/IR/InstIterator.h"
 #include "llvm/IR/Instruction.h"
 #include "llvm/Support/raw_ostream.h"
 
-#include <map>
-
 using namespace llvm;
 
 namespace {
@@ -15,18 +14,14 @@ struct CountSIPass : public FunctionPass {
   CountSIPass() : FunctionPass(ID) { }
 
   bool runOnFunction(Function& F) override {
-    std::map<const char*, int> inst_count;
-
-    for (inst_iterator inst_it = inst_begin(F), inst_e = inst_end(F);
-         inst_it != inst_e; ++inst_it) {
-      Instruction& inst = *inst_it;
+    uint64_t inst_count[kNumOpcodes] = {0};
 
-      inst_count[inst.getOpcodeName()] += 1;
-    }
+    CountOpcodes(F, inst_count);
 
-    for (std::map<const char*, int>::iterator it = inst_count.begin();
-         it != inst_count.end(); ++it) {
-      errs() << it->first << '\t' << it->second << '\n';
+    for (unsigned op = 0; op < kNumOpcodes; ++op) {
+      if (inst_count[op] != 0) {
+        ResultStream() << Instruction::getOpcodeName(op) << '\t' << inst_count[op] << '\n';
+      }
     }
     return false;
   }
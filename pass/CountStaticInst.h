@@ -0,0 +1,26 @@
+#ifndef LLVM_COUNT_STATIC_INST_H
+#define LLVM_COUNT_STATIC_INST_H
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instruction.h"
+
+#include <stdint.h>
+
+namespace llvm {
+
+// Size of an opcode-indexed counter array.
+const unsigned kNumOpcodes = Instruction::OtherOpsEnd;
+
+// Adds the number of instructions of each opcode in <F> to <counts>, which
+// holds kNumOpcodes counters.
+inline void CountOpcodes(const Function& F, uint64_t* counts) {
+  for (const_inst_iterator inst_it = inst_begin(F), inst_e = inst_end(F);
+       inst_it != inst_e; ++inst_it) {
+    counts[inst_it->getOpcode()] += 1;
+  }
+}
+
+}
+
+#endif
@@ -0,0 +1,154 @@
+#include "CounterPromotion.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Analysis/ScalarEvolutionExpander.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Transforms/Utils/PromoteMemToReg.h"
+
+using namespace llvm;
+
+static cl::opt<bool> promote_counters(
+    "promote-counters",
+    cl::desc("Keep profile counters of loops in registers and write them back "
+             "at the loop exits; counts of loops left by exit() or longjmp "
+             "are lost"),
+    cl::init(false));
+
+bool llvm::CounterPromotionEnabled() {
+  return promote_counters;
+}
+
+Loop* CounterPromoter::OutermostLoop(BasicBlock* block) {
+  Loop* loop = LI_.getLoopFor(block);
+
+  while (loop != nullptr && loop->getParentLoop() != nullptr) {
+    loop = loop->getParentLoop();
+  }
+  return loop;
+}
+
+bool CounterPromoter::IsPromotable(Loop* loop) {
+  auto it = promotable_.find(loop);
+  if (it != promotable_.end()) {
+    return it->second;
+  }
+
+  bool promotable = loop->getLoopPreheader() != nullptr && loop->hasDedicatedExits();
+  if (promotable) {
+    SmallVector<BasicBlock*, 4> exits;
+    loop->getUniqueExitBlocks(exits);
+
+    // The write back goes to the top of each exit, which a catchswitch
+    // does not have.
+    for (BasicBlock* exit : exits) {
+      if (exit->getFirstInsertionPt() == exit->end()) {
+        promotable = false;
+      }
+    }
+  }
+
+  promotable_[loop] = promotable;
+  return promotable;
+}
+
+AllocaInst* CounterPromoter::Accumulator(Loop* loop, uint64_t key) {
+  AllocaInst*& acc = accumulators_[std::make_pair(loop, key)];
+
+  if (acc == nullptr) {
+    IRBuilder<> builder(&*F_.getEntryBlock().getFirstInsertionPt());
+    acc = builder.CreateAlloca(builder.getInt64Ty(), nullptr, "prof.acc");
+
+    builder.SetInsertPoint(loop->getLoopPreheader()->getTerminator());
+    builder.CreateStore(builder.getInt64(0), acc);
+  }
+  return acc;
+}
+
+void CounterPromoter::Accumulate(AllocaInst* acc, Instruction* pt, Value* value) {
+  IRBuilder<> builder(pt);
+  builder.CreateStore(builder.CreateAdd(builder.CreateLoad(acc), value), acc);
+}
+
+bool CounterPromoter::Promotes(BasicBlock* block) {
+  Loop* loop = OutermostLoop(block);
+  return loop != nullptr && IsPromotable(loop);
+}
+
+bool CounterPromoter::Add(Instruction* pt, uint64_t key, Value* value) {
+  Loop* loop = OutermostLoop(pt->getParent());
+
+  if (loop == nullptr || !IsPromotable(loop)) {
+    return false;
+  }
+
+  Accumulate(Accumulator(loop, key), pt, value);
+  return true;
+}
+
+bool CounterPromoter::AddIterations(BasicBlock* block, uint64_t key, ScalarEvolution& SE) {
+  Loop* loop = LI_.getLoopFor(block);
+  Loop* outer = OutermostLoop(block);
+
+  if (loop == nullptr || !IsPromotable(outer)) {
+    return false;
+  }
+
+  BasicBlock* preheader = loop->getLoopPreheader();
+  BasicBlock* exiting = loop->getExitingBlock();
+  BasicBlock* latch = loop->getLoopLatch();
+  if (preheader == nullptr || exiting == nullptr || latch == nullptr ||
+      !DT_.dominates(exiting, latch)) {
+    return false;
+  }
+
+  // Every iteration passes the only exiting block on its way to the latch.
+  // Blocks before it run on every iteration including the last one, blocks
+  // between it and the latch on all but the last.
+  uint64_t extra;
+  if (DT_.dominates(block, exiting)) {
+    extra = 1;
+  } else if (DT_.dominates(exiting, block) && DT_.dominates(block, latch)) {
+    extra = 0;
+  } else {
+    return false;
+  }
+
+  const SCEV* backedge_count = SE.getBackedgeTakenCount(loop);
+  if (isa<SCEVCouldNotCompute>(backedge_count) || !isSafeToExpand(backedge_count, SE)) {
+    return false;
+  }
+
+  // The preheader of an outermost loop is where its accumulators are
+  // zeroed, which has to come first.
+  AllocaInst* acc = Accumulator(outer, key);
+
+  SCEVExpander expander(SE, F_.getParent()->getDataLayout(), "prof");
+  Instruction* pt = preheader->getTerminator();
+  Value* n = expander.expandCodeFor(backedge_count, backedge_count->getType(), pt);
+
+  IRBuilder<> builder(pt);
+  n = builder.CreateZExtOrTrunc(n, builder.getInt64Ty());
+  Accumulate(acc, pt, builder.CreateAdd(n, builder.getInt64(extra)));
+  return true;
+}
+
+void CounterPromoter::Finish() {
+  std::vector<AllocaInst*> allocas;
+
+  for (const auto& acc : accumulators_) {
+    SmallVector<BasicBlock*, 4> exits;
+    acc.first.first->getUniqueExitBlocks(exits);
+
+    for (BasicBlock* exit : exits) {
+      IRBuilder<> builder(&*exit->getFirstInsertionPt());
+      flush_(builder, acc.first.second, builder.CreateLoad(acc.second));
+    }
+    allocas.push_back(acc.second);
+  }
+
+  if (!allocas.empty()) {
+    PromoteMemToReg(allocas, DT_);
+  }
+  accumulators_.clear();
+}
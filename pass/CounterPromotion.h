@@ -0,0 +1,78 @@
+#ifndef LLVM_COUNTER_PROMOTION_H
+#define LLVM_COUNTER_PROMOTION_H
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+
+#include <functional>
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace llvm {
+
+// Whether -promote-counters is given.
+bool CounterPromotionEnabled();
+
+// Keeps counters updated inside loops in registers and adds them to memory
+// once per exit of the outermost loop, instead of loading and storing the
+// counter on every iteration.
+//
+// A counter is identified by a key chosen by the instrumentation, which
+// also decides how a promoted value is written back through <flush>. Loops
+// are never restructured: only loops that already have a preheader and
+// dedicated exits are promoted, so the CFG and with it the profile
+// checksum stay as they are.
+class CounterPromoter {
+ public:
+  // Emits code at <builder> adding the i64 <value> to the counter <key>.
+  typedef std::function<void(IRBuilder<>& builder, uint64_t key, Value* value)> FlushFn;
+
+  CounterPromoter(Function& F, LoopInfo& LI, DominatorTree& DT, FlushFn flush)
+    : F_(F), LI_(LI), DT_(DT), flush_(flush) { }
+
+  // Whether counters in <block> are kept in registers.
+  bool Promotes(BasicBlock* block);
+
+  // Adds the i64 <value> to the counter <key> before <pt>, in a register if
+  // <pt> is inside a promotable loop. Returns false, emitting nothing,
+  // otherwise.
+  bool Add(Instruction* pt, uint64_t key, Value* value);
+
+  // Counts the executions of <block> into <key> from the trip count of its
+  // loop, computed once in the preheader, if <block> runs exactly once per
+  // iteration and the trip count is known on entry. Returns false, emitting
+  // nothing, otherwise.
+  bool AddIterations(BasicBlock* block, uint64_t key, ScalarEvolution& SE);
+
+  // Writes the promoted counters back at the loop exits and turns their
+  // temporaries into registers. Must be called once, after the last Add.
+  void Finish();
+
+ private:
+  Loop* OutermostLoop(BasicBlock* block);
+  bool IsPromotable(Loop* loop);
+
+  // Temporary holding counter <key> inside <loop>, zeroed in its preheader.
+  AllocaInst* Accumulator(Loop* loop, uint64_t key);
+
+  // Emits acc += <value> before <pt>.
+  void Accumulate(AllocaInst* acc, Instruction* pt, Value* value);
+
+  Function& F_;
+  LoopInfo& LI_;
+  DominatorTree& DT_;
+  FlushFn flush_;
+
+  DenseMap<Loop*, bool> promotable_;
+  std::map<std::pair<Loop*, uint64_t>, AllocaInst*> accumulators_;
+};
+
+}
+
+#endif
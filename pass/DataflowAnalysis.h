@@ -1,6 +1,8 @@
 #ifndef LLVM_DATAFLOW_ANALYSIS_H
 #define LLVM_DATAFLOW_ANALYSIS_H
 
+#include "AnalysisCache.h"
+#include "ResultStream.h"
 #include "llvm/InitializePasses.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/CFG.h"
@@ -8,6 +10,7 @@
 #include "llvm/IR/InstIterator.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/Support/raw_ostream.h"
+#include <algorithm>
 #include <deque>
 #include <map>
 #include <memory>
@@ -36,6 +39,8 @@ class DataFlowAnalysis {
   std::map<Instruction*, int> inst_map_;
 
   std::vector<Info> edges_;
+  std::vector<int> edge_src_;
+  std::vector<int> free_edges_; // Ids of detached edges, reused first.
   std::map<int, std::vector<Edge>> in_edges_;
   std::map<int, std::vector<Edge>> out_edges_;
   std::map<int, std::set<int>> existing_edges_;
@@ -43,10 +48,21 @@ class DataFlowAnalysis {
   Info bottom_;
   Info initial_state_;
   Instruction* entry_inst_;
+  Function* function_;
+  bool solved_;
+
+  // Memoized answers of demand-driven queries, <edge id, fact> -> holds.
+  std::map<std::pair<int, int>, bool> query_memo_;
+
+  // Parts of the function edited since the last fixpoint.
+  std::set<BasicBlock*> dirty_blocks_;
+  std::set<int> dirty_nodes_;
 
   void AssignIndexToInst(Function* F) {
     int cnt = 1, i = 1;
 
+    function_ = F;
+
     for (inst_iterator inst_it = inst_begin(F), inst_e = inst_end(F);
          inst_it != inst_e; ++inst_it) {
       cnt += 1;
@@ -74,63 +90,120 @@ class DataFlowAnalysis {
     }
 
     int src_index = src_it->second, dst_index = dst_it->second;
-    int new_index = edges_.size();
+    int new_index;
 
     if (existing_edges_[src_index].count(dst_index)) {
       return;
     }
     existing_edges_[src_index].insert(dst_index);
 
-    edges_.push_back(e);
+    if (free_edges_.empty()) {
+      new_index = edges_.size();
+      edges_.push_back(e);
+      edge_src_.push_back(src_index);
+    } else {
+      new_index = free_edges_.back();
+      free_edges_.pop_back();
+      edges_[new_index] = e;
+      edge_src_[new_index] = src_index;
+    }
     in_edges_[dst_index].push_back(std::make_pair(src_index, new_index));
     out_edges_[src_index].push_back(std::make_pair(dst_index, new_index));
   }
 
-  void InitializeForwardMap(Function* F) {
-    AssignIndexToInst(F);
+  // Adds the edges of <block> for a forward analysis: incoming edges from
+  // predecessors, edges within the block and outgoing edges to successors.
+  void WireForwardBlock(BasicBlock* block) {
+    Instruction* first_inst = &(block->front());
+
+    // Initialize incoming edges to the basic block.
+    for (auto pred_it = pred_begin(block), pred_e = pred_end(block);
+         pred_it != pred_e; ++pred_it) {
+      BasicBlock* prev = *pred_it;
+      Instruction* src = (Instruction*) prev->getTerminator();
+      Instruction* dst = first_inst;
+      AddEdge(src, dst, bottom_);
+    }
 
-    for (Function::iterator blk_it = F->begin(), blk_e = F->end();
-         blk_it != blk_e; ++blk_it) {
-      BasicBlock* block = &*blk_it;
-      Instruction* first_inst = &(block->front());
-
-      // Initialize incoming edges to the basic block.
-      for (auto pred_it = pred_begin(block), pred_e = pred_end(block);
-           pred_it != pred_e; ++pred_it) {
-        BasicBlock* prev = *pred_it;
-        Instruction* src = (Instruction*) prev->getTerminator();
-        Instruction* dst = first_inst;
-        AddEdge(src, dst, bottom_);
-      }
+    // If there is at least one phi node, add an edge from the first phi node
+    // to the first non-phi node instruction in the basic block.
+    if (isa<PHINode>(first_inst)) {
+      AddEdge(first_inst, block->getFirstNonPHI(), bottom_);
+    }
 
-      // If there is at least one phi node, add an edge from the first phi node
-      // to the first non-phi node instruction in the basic block.
-      if (isa<PHINode>(first_inst)) {
-        AddEdge(first_inst, block->getFirstNonPHI(), bottom_);
+    // Initialize edges within the basic block.
+    for (auto inst_it = block->begin(), inst_e = block->end();
+         inst_it != inst_e; ++inst_it) {
+      Instruction* inst = &*inst_it;
+      if (isa<PHINode>(inst)) {
+        continue;
       }
-
-      // Initialize edges within the basic block.
-      for (auto inst_it = block->begin(), inst_e = block->end();
-           inst_it != inst_e; ++inst_it) {
-        Instruction* inst = &*inst_it;
-        if (isa<PHINode>(inst)) {
-          continue;
-        }
-        if (inst == (Instruction *) block->getTerminator()) {
-          break;
-        }
-        Instruction* next = inst->getNextNode();
-        AddEdge(inst, next, bottom_);
+      if (inst == (Instruction *) block->getTerminator()) {
+        break;
       }
+      Instruction* next = inst->getNextNode();
+      AddEdge(inst, next, bottom_);
+    }
 
-      // Initialize outgoing edges of the basic block.
-      Instruction* term = (Instruction *) block->getTerminator();
-      for (auto succ_it = succ_begin(block), succ_e = succ_end(block);
-           succ_it != succ_e; ++succ_it) {
-        BasicBlock* succ = *succ_it;
-        Instruction* next = &(succ->front());
-        AddEdge(term, next, bottom_);
+    // Initialize outgoing edges of the basic block.
+    Instruction* term = (Instruction *) block->getTerminator();
+    for (auto succ_it = succ_begin(block), succ_e = succ_end(block);
+         succ_it != succ_e; ++succ_it) {
+      BasicBlock* succ = *succ_it;
+      Instruction* next = &(succ->front());
+      AddEdge(term, next, bottom_);
+    }
+  }
+
+  // Mirror of WireForwardBlock() for backward analyses.
+  void WireBackwardBlock(BasicBlock* block) {
+    Instruction* first_inst = &(block->front());
+
+    // Initialize outgoing edges to the basic block.
+    for (auto pred_it = pred_begin(block), pred_e = pred_end(block);
+         pred_it != pred_e; ++pred_it) {
+      BasicBlock* prev = *pred_it;
+      Instruction* dst = (Instruction*) prev->getTerminator();
+      Instruction* src = first_inst;
+      AddEdge(src, dst, bottom_);
+    }
+
+    // If there is at least one phi node, add an edge from the first non-phi node instruction
+    // in the basic block to the first phi node.
+    if (isa<PHINode>(first_inst)) {
+      AddEdge(block->getFirstNonPHI(), first_inst, bottom_);
+    }
+
+    // Initialize edges within the basic block.
+    for (auto inst_it = block->begin(), inst_e = block->end();
+         inst_it != inst_e; ++inst_it) {
+      Instruction* inst = &*inst_it;
+      if (isa<PHINode>(inst)) {
+        continue;
+      }
+      if (inst == block->getTerminator()) {
+        break;
       }
+      Instruction* next = inst->getNextNode();
+      AddEdge(next, inst, bottom_);
+    }
+
+    // Initialize incoming edges of the basic block.
+    Instruction* term = (Instruction *) block->getTerminator();
+    for (auto succ_it = succ_begin(block), succ_e = succ_end(block);
+         succ_it != succ_e; ++succ_it) {
+      BasicBlock* succ = *succ_it;
+      Instruction* next = &(succ->front());
+      AddEdge(next, term, bottom_);
+    }
+  }
+
+  void InitializeForwardMap(Function* F) {
+    AssignIndexToInst(F);
+
+    for (Function::iterator blk_it = F->begin(), blk_e = F->end();
+         blk_it != blk_e; ++blk_it) {
+      WireForwardBlock(&*blk_it);
     }
 
     entry_inst_ = (Instruction *) &((F->front()).front());
@@ -142,51 +215,163 @@ class DataFlowAnalysis {
 
     for (Function::iterator blk_it = F->begin(), blk_e = F->end();
          blk_it != blk_e; ++blk_it) {
-      BasicBlock* block = &*blk_it;
+      WireBackwardBlock(&*blk_it);
+    }
 
-      Instruction* first_inst = &(block->front());
+    entry_inst_ = F->back().getTerminator();
+    AddEdge(nullptr, entry_inst_, initial_state_);
+  }
 
-      // Initialize outgoing edges to the basic block.
-      for (auto pred_it = pred_begin(block), pred_e = pred_end(block);
-           pred_it != pred_e; ++pred_it) {
-        BasicBlock* prev = *pred_it;
-        Instruction* dst = (Instruction*) prev->getTerminator();
-        Instruction* src = first_inst;
-        AddEdge(src, dst, bottom_);
-      }
+  void ResetGraph() {
+    insts_.clear();
+    inst_map_.clear();
+    edges_.clear();
+    edge_src_.clear();
+    free_edges_.clear();
+    in_edges_.clear();
+    out_edges_.clear();
+    existing_edges_.clear();
+    entry_inst_ = nullptr;
+    function_ = nullptr;
+    solved_ = false;
+    query_memo_.clear();
+    dirty_blocks_.clear();
+    dirty_nodes_.clear();
+  }
+
+  // Removes every edge entering or leaving node <node>. Their ids are
+  // reused by the edges added next.
+  void DetachNode(int node) {
+    std::set<int> detached;
+
+    for (const Edge& out : out_edges_[node]) {
+      std::vector<Edge>& ins = in_edges_[out.first];
+      ins.erase(std::remove(ins.begin(), ins.end(), std::make_pair(node, out.second)),
+                ins.end());
+      detached.insert(out.second);
+    }
+    for (const Edge& in : in_edges_[node]) {
+      std::vector<Edge>& outs = out_edges_[in.first];
+      outs.erase(std::remove(outs.begin(), outs.end(), std::make_pair(node, in.second)),
+                 outs.end());
+      existing_edges_[in.first].erase(node);
+      detached.insert(in.second);
+    }
+    out_edges_.erase(node);
+    in_edges_.erase(node);
+    existing_edges_.erase(node);
+    free_edges_.insert(free_edges_.end(), detached.begin(), detached.end());
+  }
+
+  // Node of <I>, an instruction of a dirty block. Instructions that were
+  // never reported through NotifyInstructionInserted() are registered here,
+  // so that they get a node of their own.
+  int DirtyNodeOf(Instruction* I) {
+    std::map<Instruction*, int>::iterator it = inst_map_.find(I);
+    if (it != inst_map_.end()) {
+      return it->second;
+    }
+
+    int node = insts_.size();
+    inst_map_[I] = node;
+    insts_.push_back(I);
+    return node;
+  }
+
+  void BuildGraph(Function* F) {
+    if (Direction) {
+      InitializeForwardMap(F);
+    } else {
+      InitializeBackwardMap(F);
+    }
+  }
+
+  // How the flow function of node <node> treats <fact> on its outgoing edge
+  // <edge>. Only meaningful for gen/kill style analyses, where the answer can
+  // be read off by feeding the flow function an empty and a singleton input.
+  enum FactEffect { kGen, kKill, kTransparent };
+
+  FactEffect GetFactEffect(int node, int edge, int fact) const {
+    std::map<int, std::vector<Edge>>::const_iterator it = out_edges_.find(node);
+    assert(it != out_edges_.end());
+
+    const std::vector<Edge>& outs = it->second;
+    size_t i = 0;
+    while (outs[i].second != edge) {
+      i += 1;
+    }
+
+    std::vector<Info> from_empty, from_fact;
+    FlowFunction(insts_[node], node, Info(), outs, from_empty);
+    if (from_empty[i].contains(fact)) {
+      return kGen;
+    }
+    FlowFunction(insts_[node], node, Info::Singleton(fact), outs, from_fact);
+    return from_fact[i].contains(fact) ? kTransparent : kKill;
+  }
+
+  // Whether <fact> holds on edge <edge>, found by walking against the flow
+  // direction until a node generating <fact> is met. Every edge proven along
+  // the way is memoized, so later queries stop as soon as they hit it.
+  bool QueryEdge(int edge, int fact) {
+    std::map<std::pair<int, int>, bool>::iterator memo_it =
+        query_memo_.find(std::make_pair(edge, fact));
+    if (memo_it != query_memo_.end()) {
+      return memo_it->second;
+    }
 
-      // If there is at least one phi node, add an edge from the first non-phi node instruction
-      // in the basic block to the first phi node.
-      if (isa<PHINode>(first_inst)) {
-        AddEdge(block->getFirstNonPHI(), first_inst, bottom_);
+    std::vector<int> stack(1, edge);
+    std::map<int, int> child; // edge -> the edge it was reached from.
+    int found = -1;
+
+    child[edge] = -1;
+    while (!stack.empty() && found < 0) {
+      int cur = stack.back();
+      stack.pop_back();
+
+      memo_it = query_memo_.find(std::make_pair(cur, fact));
+      if (memo_it != query_memo_.end()) {
+        if (memo_it->second) {
+          found = cur;
+        }
+        continue;
       }
 
-      // Initialize edges within the basic block.
-      for (auto inst_it = block->begin(), inst_e = block->end();
-           inst_it != inst_e; ++inst_it) {
-        Instruction* inst = &*inst_it;
-        if (isa<PHINode>(inst)) {
-          continue;
+      int src = edge_src_[cur];
+      if (src == 0) {
+        // The boundary edge carries the initial state.
+        if (initial_state_.contains(fact)) {
+          found = cur;
         }
-        if (inst == block->getTerminator()) {
-          break;
+        continue;
+      }
+
+      FactEffect effect = GetFactEffect(src, cur, fact);
+      if (effect == kGen) {
+        found = cur;
+      } else if (effect == kTransparent) {
+        for (const Edge& in : in_edges_[src]) {
+          if (!child.count(in.second)) {
+            child[in.second] = cur;
+            stack.push_back(in.second);
+          }
         }
-        Instruction* next = inst->getNextNode();
-        AddEdge(next, inst, bottom_);
       }
+    }
 
-      // Initialize incoming edges of the basic block.
-      Instruction* term = (Instruction *) block->getTerminator();
-      for (auto succ_it = succ_begin(block), succ_e = succ_end(block);
-           succ_it != succ_e; ++succ_it) {
-        BasicBlock* succ = *succ_it;
-        Instruction* next = &(succ->front());
-        AddEdge(next, term, bottom_);
+    if (found >= 0) {
+      // Only the path from the generating edge back to the query is known.
+      for (int e = found; e >= 0; e = child[e]) {
+        query_memo_[std::make_pair(e, fact)] = true;
       }
+      return true;
     }
 
-    entry_inst_ = F->back().getTerminator();
-    AddEdge(nullptr, entry_inst_, initial_state_);
+    // The whole explored region failed to reach a generating node.
+    for (std::map<int, int>::iterator it = child.begin(); it != child.end(); ++it) {
+      query_memo_[std::make_pair(it->first, fact)] = false;
+    }
+    return false;
   }
 
   virtual void FlowFunction(
@@ -199,29 +384,78 @@ class DataFlowAnalysis {
 
  public:
   DataFlowAnalysis(const Info& bottom, const Info& initial_state)
-    : bottom_(bottom), initial_state_(initial_state), entry_inst_(nullptr) { }
+    : bottom_(bottom), initial_state_(initial_state), entry_inst_(nullptr),
+      function_(nullptr), solved_(false) { }
 
   virtual ~DataFlowAnalysis() { }
 
+  // Prints the facts of every edge in -result-format, if the result filters
+  // want the analyzed function and the edge.
   void Print() {
+    if (function_ == nullptr || !WantsResultsOf(function_->getName())) {
+      return;
+    }
+
+    BeginFunctionResults(function_->getName());
     for (std::map<int, std::vector<Edge>>::iterator it = out_edges_.begin();
          it != out_edges_.end(); ++it) {
       for (const Edge& e : it->second) {
-        errs() << "Edge " << it->first << "->" "Edge " << e.first << ":";
-        edges_[e.second].Print();
+        PrintEdge(it->first, e.first, edges_[e.second]);
+      }
+    }
+    FlushResultStream();
+  }
+
+  // Index of <I> used in analysis facts, or 0 if <I> is unknown.
+  int IndexOf(Instruction* I) const {
+    std::map<Instruction*, int>::const_iterator it = inst_map_.find(I);
+    return it == inst_map_.end() ? 0 : it->second;
+  }
+
+  // The instruction of index <index>.
+  Instruction* InstructionAt(int index) const {
+    return insts_[index];
+  }
+
+  // Builds the graph of <F> for demand-driven queries without solving it.
+  void PrepareQueries(Function* F) {
+    if (insts_.empty()) {
+      BuildGraph(F);
+    }
+  }
+
+  // Answers whether <fact> holds on the input side of <I>, i.e. before <I>
+  // for forward analyses and after <I> for backward ones. Only the part of
+  // the graph that can influence the answer is explored, and answers are
+  // memoized across queries. Requires a gen/kill analysis whose Info offers
+  // contains() and Singleton().
+  bool QueryFact(Instruction* I, int fact) {
+    int node = IndexOf(I);
+    assert(node != 0 && "instruction is not part of the analyzed function");
+
+    for (const Edge& in : in_edges_[node]) {
+      if (solved_ ? edges_[in.second].contains(fact) : QueryEdge(in.second, fact)) {
+        return true;
       }
     }
+    return false;
+  }
+
+  // Joined facts on the input side of <I> in a solved graph.
+  Info InputInfo(Instruction* I) {
+    std::unique_ptr<Info> joined(new Info());
+
+    for (const Edge& in : in_edges_[IndexOf(I)]) {
+      joined = Info::Join(joined.get(), &edges_[in.second]);
+    }
+    return *joined;
   }
 
   void RunWorklistAlgorithm(Function* F) {
     std::deque<int> worklist;
 
     // Initialize info of each edge to bottom.
-    if (Direction) {
-      InitializeForwardMap(F);
-    } else {
-      InitializeBackwardMap(F);
-    }
+    BuildGraph(F);
 
     assert(entry_inst_ != nullptr);
 
@@ -230,6 +464,229 @@ class DataFlowAnalysis {
       worklist.push_back(i);
     }
 
+    SolveWorklist(worklist);
+  }
+
+  // Serializes the edges of a solved graph and their facts into <out>. Nodes
+  // are identified by instruction index, so the result can be loaded into
+  // any function with the same structure.
+  void SaveResult(std::string& out) const {
+    size_t num_edges = 0;
+    for (const auto& outs : out_edges_) {
+      num_edges += outs.second.size();
+    }
+
+    WriteVarint(out, insts_.size());
+    WriteVarint(out, num_edges);
+    for (const auto& outs : out_edges_) {
+      for (const Edge& e : outs.second) {
+        WriteVarint(out, outs.first);
+        WriteVarint(out, e.first);
+        edges_[e.second].Serialize(out);
+      }
+    }
+  }
+
+  // Rebuilds the solved graph of <F> from the output of SaveResult().
+  // Returns false and leaves the analysis empty if <data> does not fit <F>.
+  bool LoadResult(Function* F, StringRef data) {
+    const char* p = data.begin();
+    const char* end = data.end();
+    uint64_t num_insts, num_edges;
+
+    ResetGraph();
+    AssignIndexToInst(F);
+
+    if (!ReadVarint(p, end, num_insts) || num_insts != insts_.size() ||
+        !ReadVarint(p, end, num_edges)) {
+      ResetGraph();
+      return false;
+    }
+
+    for (uint64_t i = 0; i < num_edges; ++i) {
+      uint64_t src, dst;
+      Info info;
+
+      if (!ReadVarint(p, end, src) || !ReadVarint(p, end, dst) ||
+          src >= num_insts || dst == 0 || dst >= num_insts ||
+          !info.Deserialize(p, end)) {
+        ResetGraph();
+        return false;
+      }
+      if (src == 0) {
+        entry_inst_ = insts_[dst];
+      }
+      AddEdge(insts_[src], insts_[dst], info);
+    }
+
+    if (p != end || entry_inst_ == nullptr) {
+      ResetGraph();
+      return false;
+    }
+    solved_ = true;
+    return true;
+  }
+
+  // Same as RunWorklistAlgorithm(), but when -dfa-cache-dir is given the
+  // result is looked up by the structural hash of <F> first, and stored
+  // there after solving on a miss. <analysis> and <version> name the cache
+  // entries; bump <version> whenever the flow function changes.
+  void RunCachedWorklistAlgorithm(Function* F, StringRef analysis, unsigned version) {
+    if (GetAnalysisCacheDir().empty()) {
+      RunWorklistAlgorithm(F);
+      return;
+    }
+
+    uint64_t hash = HashFunctionStructure(*F);
+    std::string data;
+
+    if (ReadAnalysisCache(analysis, version, hash, data) && LoadResult(F, data)) {
+      return;
+    }
+
+    RunWorklistAlgorithm(F);
+    data.clear();
+    SaveResult(data);
+    WriteAnalysisCache(analysis, version, hash, data);
+  }
+
+  // Notifications about edits of the analyzed function. They only record
+  // what changed; UpdateAnalysis() repairs the graph and the fixpoint.
+  void NotifyInstructionInserted(Instruction* I) {
+    inst_map_[I] = insts_.size();
+    insts_.push_back(I);
+    dirty_blocks_.insert(I->getParent());
+  }
+
+  // Must be called while <I> is still attached to its block.
+  void NotifyInstructionRemoved(Instruction* I) {
+    std::map<Instruction*, int>::iterator it = inst_map_.find(I);
+    assert(it != inst_map_.end());
+
+    DetachNode(it->second);
+    dirty_nodes_.erase(it->second);
+    insts_[it->second] = nullptr;
+    inst_map_.erase(it);
+    dirty_blocks_.insert(I->getParent());
+  }
+
+  void NotifyInstructionChanged(Instruction* I) {
+    int node = IndexOf(I);
+    assert(node != 0);
+    dirty_nodes_.insert(node);
+  }
+
+  void NotifyEdgeInserted(BasicBlock* from, BasicBlock* to) {
+    dirty_blocks_.insert(from);
+    dirty_blocks_.insert(to);
+  }
+
+  void NotifyEdgeRemoved(BasicBlock* from, BasicBlock* to) {
+    dirty_blocks_.insert(from);
+    dirty_blocks_.insert(to);
+  }
+
+  // Must be called before <block> is erased; its instructions are dropped
+  // from the graph.
+  void NotifyBlockRemoved(BasicBlock* block) {
+    for (Instruction& inst : *block) {
+      if (inst_map_.count(&inst)) {
+        NotifyInstructionRemoved(&inst);
+      }
+    }
+    dirty_blocks_.erase(block);
+  }
+
+  // Brings the fixpoint up to date after the edits reported since the last
+  // solve. Dirty blocks are rewired, then only the nodes reachable from the
+  // edits along the flow direction are reset and re-solved; facts elsewhere
+  // cannot depend on the edits and are kept as they are.
+  void UpdateAnalysis(Function* F) {
+    std::set<int> seeds(dirty_nodes_.begin(), dirty_nodes_.end());
+
+    for (BasicBlock* block : dirty_blocks_) {
+      for (Instruction& inst : *block) {
+        DetachNode(DirtyNodeOf(&inst));
+      }
+    }
+    for (BasicBlock* block : dirty_blocks_) {
+      if (Direction) {
+        WireForwardBlock(block);
+      } else {
+        WireBackwardBlock(block);
+      }
+      for (Instruction& inst : *block) {
+        seeds.insert(IndexOf(&inst));
+      }
+    }
+
+    // The boundary edge follows the entry (or exit) instruction.
+    Instruction* entry = Direction ? &F->front().front() : F->back().getTerminator();
+    if (entry != entry_inst_ || out_edges_[0].empty()) {
+      DetachNode(0);
+      entry_inst_ = entry;
+      AddEdge(nullptr, entry_inst_, initial_state_);
+      seeds.insert(IndexOf(entry_inst_));
+    }
+
+    // Collect the region affected by the edits and reset it to bottom.
+    std::set<int> region;
+    std::vector<int> stack(seeds.begin(), seeds.end());
+    while (!stack.empty()) {
+      int cur = stack.back();
+      stack.pop_back();
+      if (!region.insert(cur).second) {
+        continue;
+      }
+      for (const Edge& out : out_edges_[cur]) {
+        edges_[out.second] = bottom_;
+        stack.push_back(out.first);
+      }
+    }
+
+    dirty_blocks_.clear();
+    dirty_nodes_.clear();
+    query_memo_.clear();
+
+    std::deque<int> worklist(region.begin(), region.end());
+    SolveWorklist(worklist);
+  }
+
+ protected:
+  // Prints <info>, the facts on the edge <src> -> <dst>, unless the result
+  // filters leave the input side of <dst> out.
+  void PrintEdge(int src, int dst, Info& info) const {
+    if (!WantsResultsAt(dst)) {
+      return;
+    }
+
+    raw_ostream& os = ResultStream();
+    switch (GetResultFormat()) {
+      case RESULT_TEXT: {
+        os << "Edge " << src << "->" "Edge " << dst << ":";
+        info.Print();
+      } break;
+
+      case RESULT_JSONL: {
+        os << "{\"function\":";
+        WriteJSONString(os, function_->getName());
+        os << ",\"src\":" << src << ",\"dst\":" << dst << ",\"facts\":";
+        info.PrintJSON(os);
+        os << "}\n";
+      } break;
+
+      case RESULT_BINARY: {
+        std::string record(1, 'E');
+        WriteVarint(record, src);
+        WriteVarint(record, dst);
+        info.Serialize(record);
+        os << record;
+      } break;
+    }
+  }
+
+  // Iterates flow functions from <worklist> until the edge facts stabilize.
+  void SolveWorklist(std::deque<int>& worklist) {
     // Compute until the work list is empty.
     std::vector<Info> newly_computed;
 
@@ -261,6 +718,7 @@ class DataFlowAnalysis {
         }
       }
     }
+    solved_ = true;
   }
 };
 
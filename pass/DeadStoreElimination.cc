@@ -0,0 +1,78 @@
+#include "LivenessAnalysis.h"
+#include "PointerAnalysis.h"
+#include "llvm/Pass.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Transforms/Utils/Local.h"
+
+#include <set>
+#include <vector>
+
+using namespace llvm;
+
+namespace {
+
+// Deletes stores into stack slots that are dead right after the store, by
+// the slot liveness of SlotLivenessAnalysis: nothing reads the slots the
+// store may write before they are overwritten or the function returns.
+// What the deleted stores alone kept alive, down to slots no longer
+// accessed at all, is deleted with them.
+struct DeadStoreEliminationPass : public FunctionPass {
+  static char ID;
+  DeadStoreEliminationPass() : FunctionPass(ID) { }
+
+  void getAnalysisUsage(AnalysisUsage& AU) const override {
+    AU.addRequired<TargetLibraryInfoWrapperPass>();
+  }
+
+  bool runOnFunction(Function& F) override {
+    if (F.isDeclaration()) {
+      return false;
+    }
+
+    PointerAnalysis pointers(&getAnalysis<TargetLibraryInfoWrapperPass>().getTLI());
+    pointers.Solve(&F);
+
+    StackSlots slots(&F, pointers);
+    SlotLivenessAnalysis liveness(slots);
+    liveness.RunWorklistAlgorithm(&F);
+
+    // Deleting a dead store does not change what is live anywhere, so all
+    // of them are found on the one solution.
+    std::vector<StoreInst*> dead;
+    for (inst_iterator inst_it = inst_begin(F), inst_e = inst_end(F);
+         inst_it != inst_e; ++inst_it) {
+      Instruction* I = &*inst_it;
+      if (!isa<StoreInst>(I) || !slots.OnlySlots(I) || slots.Accessed(I).empty()) {
+        continue;
+      }
+
+      bool live = false;
+      for (int slot : slots.Accessed(I)) {
+        live |= liveness.QueryFact(I, slot);
+      }
+      if (!live) {
+        dead.push_back(cast<StoreInst>(I));
+      }
+    }
+
+    for (StoreInst* store : dead) {
+      Value* value = store->getValueOperand();
+      Value* ptr = store->getPointerOperand();
+
+      store->eraseFromParent();
+      RecursivelyDeleteTriviallyDeadInstructions(value);
+      RecursivelyDeleteTriviallyDeadInstructions(ptr);
+    }
+    return !dead.empty();
+  }
+};
+
+}
+
+char DeadStoreEliminationPass::ID = 0;
+static RegisterPass<DeadStoreEliminationPass> X(
+    "slot-dse", "Delete stores into dead stack slots",
+    false /* Only looks at CFG */,
+    false /* Analysis Pass */);
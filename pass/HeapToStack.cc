@@ -0,0 +1,176 @@
+#include "PointerAnalysis.h"
+#include "llvm/Pass.h"
+#include "llvm/ADT/SCCIterator.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/Analysis/MemoryBuiltins.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/CommandLine.h"
+
+#include <map>
+#include <vector>
+
+using namespace llvm;
+
+static cl::opt<unsigned> max_size(
+    "heap-to-stack-max-size",
+    cl::desc("Largest heap allocation, in bytes, moved to the stack"),
+    cl::init(1024));
+
+namespace {
+
+// The heap allocation <call> and the frees that release it.
+struct Promoted {
+  CallInst* call;
+  uint64_t size;
+  std::vector<Instruction*> frees;
+};
+
+// Replaces heap allocations of a constant size that do not escape the
+// function by stack slots, and deletes the frees that release them. The
+// pointer analysis models malloc, calloc and operator new results as
+// objects, and StackSlots keeps tracking those whose address is only
+// accessed, freed, or stored into other tracked objects.
+//
+// Allocations in blocks that can reach themselves stay on the heap, each
+// trip would need an object of its own; this covers irreducible cycles,
+// which LoopInfo does not model. So do allocations made by invokes, and
+// those released by frees that may release other objects as well.
+struct HeapToStackPass : public FunctionPass {
+  static char ID;
+  HeapToStackPass() : FunctionPass(ID) { }
+
+  void getAnalysisUsage(AnalysisUsage& AU) const override {
+    AU.addRequired<TargetLibraryInfoWrapperPass>();
+    AU.setPreservesCFG();
+  }
+
+  // Bytes allocated by <call>, or 0 if not a constant or if the size of a
+  // calloc overflows.
+  static uint64_t AllocationSize(CallInst* call, const TargetLibraryInfo* TLI) {
+    ConstantInt* count = dyn_cast<ConstantInt>(call->getArgOperand(0));
+    if (count == nullptr) {
+      return 0;
+    }
+    if (!isCallocLikeFn(call, TLI)) {
+      // The aligned operator new takes the alignment too.
+      return call->getNumArgOperands() == 1 ? count->getZExtValue() : 0;
+    }
+
+    ConstantInt* each = dyn_cast<ConstantInt>(call->getArgOperand(1));
+    if (each == nullptr) {
+      return 0;
+    }
+
+    // Both are size_t, so the product wraps where calloc would fail.
+    bool overflow = false;
+    APInt size = count->getValue().umul_ov(each->getValue(), overflow);
+    return overflow ? 0 : size.getLimitedValue();
+  }
+
+  // Blocks of <F> on a cycle of the CFG: those of strongly connected
+  // components with more than one block or a self loop.
+  static SmallPtrSet<BasicBlock*, 16> BlocksOnCycles(Function& F) {
+    SmallPtrSet<BasicBlock*, 16> blocks;
+    for (scc_iterator<Function*> scc_it = scc_begin(&F); !scc_it.isAtEnd(); ++scc_it) {
+      if (scc_it.hasLoop()) {
+        blocks.insert(scc_it->begin(), scc_it->end());
+      }
+    }
+    return blocks;
+  }
+
+  bool runOnFunction(Function& F) override {
+    if (F.isDeclaration()) {
+      return false;
+    }
+
+    SmallPtrSet<BasicBlock*, 16> cyclic = BlocksOnCycles(F);
+    const TargetLibraryInfo* TLI = &getAnalysis<TargetLibraryInfoWrapperPass>().getTLI();
+
+    PointerAnalysis pointers(TLI);
+    pointers.Solve(&F);
+
+    StackSlots slots(&F, pointers);
+
+    std::map<int, Promoted> promoted;
+    for (inst_iterator inst_it = inst_begin(F), inst_e = inst_end(F);
+         inst_it != inst_e; ++inst_it) {
+      CallInst* call = dyn_cast<CallInst>(&*inst_it);
+      if (call == nullptr || !pointers.IsHeapAllocation(call)) {
+        continue;
+      }
+
+      int slot = PointerInfo::SlotOf(pointers.IndexOf(call));
+      uint64_t size = AllocationSize(call, TLI);
+      if (slots.IsTracked(slot) && size != 0 && size <= max_size &&
+          !cyclic.count(call->getParent())) {
+        promoted[slot] = Promoted{call, size, {}};
+      }
+    }
+
+    // A free that may release a promoted object must release nothing else.
+    for (inst_iterator inst_it = inst_begin(F), inst_e = inst_end(F);
+         inst_it != inst_e; ++inst_it) {
+      Instruction* I = &*inst_it;
+      if (!pointers.IsHeapFree(I)) {
+        continue;
+      }
+
+      const std::set<int>& accessed = slots.Accessed(I);
+      bool single = slots.OnlySlots(I) && accessed.size() == 1;
+      for (int slot : accessed) {
+        std::map<int, Promoted>::iterator it = promoted.find(slot);
+        if (it == promoted.end()) {
+          continue;
+        }
+        if (single) {
+          it->second.frees.push_back(I);
+        } else {
+          promoted.erase(it);
+        }
+      }
+    }
+
+    // Everything is inserted before anything is erased, the entry block may
+    // start with a promoted allocation.
+    IRBuilder<> entry(&*F.getEntryBlock().getFirstInsertionPt());
+    for (const auto& it : promoted) {
+      const Promoted& object = it.second;
+      CallInst* call = object.call;
+
+      // malloc memory is aligned for any type.
+      AllocaInst* alloca = entry.CreateAlloca(
+          ArrayType::get(entry.getInt8Ty(), object.size), nullptr,
+          call->getName() + ".stack");
+      alloca->setAlignment(16);
+      Value* replacement = entry.CreateBitCast(alloca, call->getType());
+
+      if (isCallocLikeFn(call, TLI)) {
+        IRBuilder<> at(call);
+        at.CreateMemSet(replacement, at.getInt8(0), object.size, 16);
+      }
+      call->replaceAllUsesWith(replacement);
+    }
+
+    for (const auto& it : promoted) {
+      it.second.call->eraseFromParent();
+      for (Instruction* release : it.second.frees) {
+        release->eraseFromParent();
+      }
+    }
+    return !promoted.empty();
+  }
+};
+
+}
+
+char HeapToStackPass::ID = 0;
+static RegisterPass<HeapToStackPass> X(
+    "heap-to-stack", "Move non-escaping heap allocations to the stack",
+    false /* Only looks at CFG */,
+    false /* Analysis Pass */);
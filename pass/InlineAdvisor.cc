@@ -0,0 +1,173 @@
+#include "Instrumentation.h"
+#include "ProfileUse.h"
+#include "llvm/Pass.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/IR/Attributes.h"
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instruction.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+
+#include <algorithm>
+#include <vector>
+
+using namespace llvm;
+
+static cl::opt<unsigned> hot_percent(
+    "inline-hot-percent",
+    cl::desc("Treat the hottest call sites that together make up this "
+             "percentage of all profiled calls as hot"),
+    cl::init(90));
+
+static cl::opt<unsigned> max_inline_size(
+    "inline-hot-max-size",
+    cl::desc("Instructions a callee may have to be always inlined into hot "
+             "call sites; larger callees get an inline hint"),
+    cl::init(300));
+
+static cl::opt<unsigned> cold_calls(
+    "inline-cold-calls",
+    cl::desc("Treat functions called at most this many times as cold"),
+    cl::init(0));
+
+namespace {
+
+// Guides the inliner by the PROF_CALL counts of -profile-use (see the csc
+// pass). The hottest call sites, those that together make up
+// -inline-hot-percent of all profiled calls, are marked alwaysinline if the
+// callee is small, and raise an inline hint on the callee otherwise.
+// Functions that ran at most -inline-cold-calls times are marked cold and
+// noinline.
+//
+// How often a function ran is its entry block count if the profile has
+// block counts for it. A local function whose every use is a profiled
+// call ran as often as those calls.
+//
+// The counts of the profile are attached to every function first (see
+// ProfileUse.h), so the passes after the inliner still find them. Blocks
+// inlined into a caller keep the counts of the callee, over all its calls.
+struct InlineAdvisorPass : public ModulePass {
+  static char ID;
+  InlineAdvisorPass() : ModulePass(ID) { }
+
+  struct Call {
+    Instruction* inst;
+    Function* callee;
+    uint64_t count;
+  };
+
+  static bool IsInlinable(const Function* caller, const Function* callee) {
+    return callee != caller && !callee->isDeclaration() && !callee->isVarArg() &&
+           !callee->isInterposable() && !callee->hasFnAttribute(Attribute::NoInline);
+  }
+
+  static uint64_t InstructionCount(const Function& F) {
+    uint64_t n = 0;
+    for (const BasicBlock& block : F) {
+      n += block.size();
+    }
+    return n;
+  }
+
+  // How often <F> ran by the profile, if that is known.
+  static bool EntryCount(const Function& F,
+                         const DenseMap<const Function*, uint64_t>& called,
+                         uint64_t& count) {
+    if (GetBlockCount(&F.getEntryBlock(), PROF_BLOCK, count)) {
+      return true;
+    }
+    if (!F.hasLocalLinkage()) {
+      return false;
+    }
+    for (const User* user : F.users()) {
+      const Instruction* inst = dyn_cast<Instruction>(user);
+      uint64_t calls;
+      if (inst == nullptr || !IsDirectCall(*inst) ||
+          ImmutableCallSite(inst).getCalledFunction() != &F ||
+          !GetCallCount(inst, calls)) {
+        return false;
+      }
+    }
+    count = called.lookup(&F);
+    return true;
+  }
+
+  bool runOnModule(Module& mod) override {
+    if (UsedProfile() == nullptr) {
+      return false;
+    }
+
+    bool changed = false;
+    for (Function& F : mod) {
+      changed |= AttachProfileCounts(F);
+    }
+
+    // Direct calls with a count.
+    std::vector<Call> calls;
+    DenseMap<const Function*, uint64_t> called;
+    uint64_t total = 0;
+    for (Function& F : mod) {
+      for (inst_iterator inst_it = inst_begin(F), inst_e = inst_end(F);
+           inst_it != inst_e; ++inst_it) {
+        uint64_t count;
+        if (IsDirectCall(*inst_it) && GetCallCount(&*inst_it, count)) {
+          Function* callee = CallSite(&*inst_it).getCalledFunction();
+          calls.push_back(Call{&*inst_it, callee, count});
+          called[callee] += count;
+          total += count;
+        }
+      }
+    }
+
+    DenseSet<const Function*> cold;
+    for (Function& F : mod) {
+      uint64_t count;
+      if (F.isDeclaration() || F.hasFnAttribute(Attribute::AlwaysInline) ||
+          !EntryCount(F, called, count) || count > cold_calls) {
+        continue;
+      }
+      cold.insert(&F);
+      F.addFnAttr(Attribute::Cold);
+      F.addFnAttr(Attribute::NoInline);
+      changed = true;
+    }
+
+    std::stable_sort(calls.begin(), calls.end(),
+                     [](const Call& a, const Call& b) {
+                       return a.count > b.count;
+                     });
+
+    uint64_t covered = 0;
+    for (const Call& call : calls) {
+      if (call.count == 0 || covered * 100 >= total * hot_percent) {
+        break;
+      }
+      covered += call.count;
+
+      Function* caller = call.inst->getFunction();
+      if (!IsInlinable(caller, call.callee) || cold.count(call.callee)) {
+        continue;
+      }
+      if (InstructionCount(*call.callee) <= max_inline_size) {
+        CallSite(call.inst).addAttribute(AttributeSet::FunctionIndex,
+                                         Attribute::AlwaysInline);
+      } else {
+        call.callee->addFnAttr(Attribute::InlineHint);
+      }
+      changed = true;
+    }
+
+    return changed;
+  }
+};
+
+}
+
+char InlineAdvisorPass::ID = 0;
+static RegisterPass<InlineAdvisorPass> X(
+    "inline-advice", "Mark call sites for inlining by profile",
+    false /* Only looks at CFG */,
+    false /* Analysis Pass */);
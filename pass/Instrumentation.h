@@ -0,0 +1,334 @@
+#ifndef LLVM_INSTRUMENTATION_H
+#define LLVM_INSTRUMENTATION_H
+
+#include "profile_format.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+
+#include <string>
+
+namespace llvm {
+
+// Prefix of the globals and functions created by the instrumentation, which
+// must not be instrumented themselves.
+const char kProfilePrefix[] = "__prof_";
+
+inline bool IsProfileHelper(const Function& F) {
+  return F.getName().startswith(kProfilePrefix);
+}
+
+// Name identifying <F> in profiles. Local functions are qualified with their
+// source file, as they may share names across modules.
+inline std::string ProfileName(const Function& F) {
+  if (F.hasLocalLinkage()) {
+    return F.getParent()->getSourceFileName() + ":" + F.getName().str();
+  }
+  return F.getName().str();
+}
+
+inline uint64_t ProfileHash(const Function& F) {
+  std::string name = ProfileName(F);
+  return prof_hash(name.data(), name.size());
+}
+
+// Hash of the shape of the CFG of <F>, so that a profile is not applied to
+// a different version of the function.
+inline uint64_t CFGChecksum(const Function& F) {
+  DenseMap<const BasicBlock*, uint64_t> index;
+  std::string shape;
+  uint64_t n = 0;
+
+  for (const BasicBlock& block : F) {
+    index[&block] = n++;
+  }
+  for (const BasicBlock& block : F) {
+    shape += std::to_string(block.getTerminator()->getNumSuccessors()) + ":";
+    for (const_succ_iterator succ_it = succ_begin(&block), succ_e = succ_end(&block);
+         succ_it != succ_e; ++succ_it) {
+      shape += std::to_string(index[*succ_it]) + ",";
+    }
+    shape += ";";
+  }
+  return prof_hash(shape.data(), shape.size());
+}
+
+// Creates a zero initialized internal array of <n> <elem_ty> for <F>.
+inline GlobalVariable* CreateProfileArray(Function& F, StringRef what, Type* elem_ty,
+                                          uint64_t n) {
+  Module& mod = *F.getParent();
+  ArrayType* array_ty = ArrayType::get(elem_ty, n);
+
+  return new GlobalVariable(
+      mod, array_ty, false /* is_constant */, GlobalValue::InternalLinkage,
+      ConstantAggregateZero::get(array_ty),
+      kProfilePrefix + what + "." + F.getName());
+}
+
+// Creates a zero initialized array of <n> 64-bit counters for <F>.
+inline GlobalVariable* CreateCounterArray(Function& F, StringRef what, uint64_t n) {
+  return CreateProfileArray(F, what, Type::getInt64Ty(F.getContext()), n);
+}
+
+// Creates a zero initialized array of <n> one-byte flags for <F>.
+inline GlobalVariable* CreateFlagArray(Function& F, StringRef what, uint64_t n) {
+  return CreateProfileArray(F, what, Type::getInt8Ty(F.getContext()), n);
+}
+
+// Emits counters[index] += <value> at the insertion point of <builder>.
+inline void EmitCounterAdd(IRBuilder<>& builder, GlobalVariable* counters,
+                           uint64_t index, Value* value) {
+  Value* ptr = builder.CreateConstInBoundsGEP2_64(counters, 0, index);
+  Value* count = builder.CreateLoad(ptr);
+  builder.CreateStore(builder.CreateAdd(count, value), ptr);
+}
+
+// Emits counters[index] += 1 at the insertion point of <builder>.
+inline void EmitCounterIncrement(IRBuilder<>& builder, GlobalVariable* counters,
+                                 uint64_t index) {
+  EmitCounterAdd(builder, counters, index, builder.getInt64(1));
+}
+
+// Emits flags[index] = 1 at the insertion point of <builder>: a single
+// store, the flag is never read back by the program.
+inline void EmitFlagSet(IRBuilder<>& builder, GlobalVariable* flags, uint64_t index) {
+  builder.CreateStore(builder.getInt8(1),
+                      builder.CreateConstInBoundsGEP2_64(flags, 0, index));
+}
+
+// Creates a module constructor named after <what>, empty but for its entry
+// block, which the caller fills and terminates.
+inline Function* CreateRegistrationCtor(Module& mod, const Twine& what) {
+  LLVMContext& ctx = mod.getContext();
+
+  Function* ctor = Function::Create(
+      FunctionType::get(Type::getVoidTy(ctx), false), GlobalValue::InternalLinkage,
+      kProfilePrefix + Twine("ctor.") + what, &mod);
+  BasicBlock::Create(ctx, "entry", ctor);
+
+  appendToGlobalCtors(mod, ctor, 0 /* priority */);
+  return ctor;
+}
+
+// Creates the module constructor registering <array>.
+inline Function* CreateRegistrationCtor(GlobalVariable* array) {
+  return CreateRegistrationCtor(*array->getParent(),
+                                array->getName().drop_front(strlen(kProfilePrefix)));
+}
+
+// Emits a module constructor that registers <counters> of <F> with the
+// profile runtime (lib/lib_prof.cc), which writes them out at exit.
+inline void EmitCounterRegistration(Function& F, prof_kind kind, uint32_t site,
+                                    GlobalVariable* counters) {
+  Module& mod = *F.getParent();
+  LLVMContext& ctx = mod.getContext();
+  uint64_t n = cast<ArrayType>(counters->getValueType())->getNumElements();
+
+  Function* registerF = cast<Function>(mod.getOrInsertFunction(
+        "registerProfileCounters",
+        Type::getVoidTy(ctx),
+        Type::getInt32Ty(ctx), /* kind */
+        Type::getInt32Ty(ctx), /* site */
+        Type::getInt64Ty(ctx), /* function hash */
+        Type::getInt64Ty(ctx), /* cfg checksum */
+        Type::getInt8PtrTy(ctx), /* name */
+        Type::getInt32Ty(ctx), /* number of counters */
+        Type::getInt64PtrTy(ctx), /* counters */
+        nullptr));
+
+  IRBuilder<> builder(&CreateRegistrationCtor(counters)->getEntryBlock());
+  builder.CreateCall(registerF, {
+      builder.getInt32(kind), builder.getInt32(site),
+      builder.getInt64(ProfileHash(F)), builder.getInt64(CFGChecksum(F)),
+      builder.CreateGlobalStringPtr(ProfileName(F)),
+      builder.getInt32(n),
+      builder.CreateConstInBoundsGEP2_64(counters, 0, 0)});
+  builder.CreateRetVoid();
+}
+
+// Creates a constant array holding the static cost of every block of <F>.
+inline GlobalVariable* CreateCostArray(Function& F, ArrayRef<uint64_t> costs) {
+  Constant* init = ConstantDataArray::get(F.getContext(), costs);
+
+  return new GlobalVariable(
+      *F.getParent(), init->getType(), true /* is_constant */,
+      GlobalValue::InternalLinkage, init, kProfilePrefix + Twine("costs.") + F.getName());
+}
+
+// Emits a module constructor that registers the block <costs> of <F> with
+// the profile runtime, which weights the block <counters> by them at exit.
+inline void EmitCostRegistration(Function& F, GlobalVariable* counters,
+                                 GlobalVariable* costs) {
+  Module& mod = *F.getParent();
+  LLVMContext& ctx = mod.getContext();
+  uint64_t n = cast<ArrayType>(costs->getValueType())->getNumElements();
+
+  Function* registerF = cast<Function>(mod.getOrInsertFunction(
+        "registerBlockCosts",
+        Type::getVoidTy(ctx),
+        Type::getInt64Ty(ctx), /* function hash */
+        Type::getInt64Ty(ctx), /* cfg checksum */
+        Type::getInt8PtrTy(ctx), /* name */
+        Type::getInt32Ty(ctx), /* number of blocks */
+        Type::getInt64PtrTy(ctx), /* counters */
+        Type::getInt64PtrTy(ctx), /* costs */
+        nullptr));
+
+  IRBuilder<> builder(&CreateRegistrationCtor(costs)->getEntryBlock());
+  builder.CreateCall(registerF, {
+      builder.getInt64(ProfileHash(F)), builder.getInt64(CFGChecksum(F)),
+      builder.CreateGlobalStringPtr(ProfileName(F)),
+      builder.getInt32(n),
+      builder.CreateConstInBoundsGEP2_64(counters, 0, 0),
+      builder.CreateConstInBoundsGEP2_64(costs, 0, 0)});
+  builder.CreateRetVoid();
+}
+
+// Emits a module constructor that registers the block coverage <flags> of
+// <F> with the coverage runtime (lib/lib_cov.cc).
+inline void EmitFlagRegistration(Function& F, GlobalVariable* flags) {
+  Module& mod = *F.getParent();
+  LLVMContext& ctx = mod.getContext();
+  uint64_t n = cast<ArrayType>(flags->getValueType())->getNumElements();
+
+  Function* registerF = cast<Function>(mod.getOrInsertFunction(
+        "registerCoverageFlags",
+        Type::getVoidTy(ctx),
+        Type::getInt64Ty(ctx), /* function hash */
+        Type::getInt64Ty(ctx), /* cfg checksum */
+        Type::getInt8PtrTy(ctx), /* name */
+        Type::getInt32Ty(ctx), /* number of blocks */
+        Type::getInt8PtrTy(ctx), /* flags */
+        nullptr));
+
+  IRBuilder<> builder(&CreateRegistrationCtor(flags)->getEntryBlock());
+  builder.CreateCall(registerF, {
+      builder.getInt64(ProfileHash(F)), builder.getInt64(CFGChecksum(F)),
+      builder.CreateGlobalStringPtr(ProfileName(F)),
+      builder.getInt32(n),
+      builder.CreateConstInBoundsGEP2_64(flags, 0, 0)});
+  builder.CreateRetVoid();
+}
+
+// Divisions and remainders whose divisor is profiled, those by a variable
+// integer. Value sites of a function are numbered in instruction order.
+inline bool IsProfiledDivision(const Instruction& inst) {
+  switch (inst.getOpcode()) {
+    case Instruction::UDiv:
+    case Instruction::SDiv:
+    case Instruction::URem:
+    case Instruction::SRem:
+      return inst.getType()->isIntegerTy() && !isa<Constant>(inst.getOperand(1));
+    default:
+      return false;
+  }
+}
+
+// Calls through a function pointer.
+inline bool IsIndirectCall(const Instruction& inst) {
+  ImmutableCallSite cs(&inst);
+  return cs && !cs.isInlineAsm() &&
+         !isa<Function>(cs.getCalledValue()->stripPointerCasts());
+}
+
+// Calls of a known function, other than intrinsics and the instrumentation.
+// Direct calls of a function are numbered in instruction order.
+inline bool IsDirectCall(const Instruction& inst) {
+  ImmutableCallSite cs(&inst);
+  const Function* callee = cs ? cs.getCalledFunction() : nullptr;
+  return callee != nullptr && !callee->isIntrinsic() && !IsProfileHelper(*callee);
+}
+
+// Number of 64-bit words in the prof_value_site of one value profile site.
+const uint64_t kValueSiteWords = sizeof(prof_value_site) / sizeof(uint64_t);
+
+// Creates zero initialized value tables for <n> sites of <F>.
+inline GlobalVariable* CreateValueSiteArray(Function& F, StringRef what, uint64_t n) {
+  return CreateCounterArray(F, what, n * kValueSiteWords);
+}
+
+// Emits a call recording the integer or pointer <value> at site <index> of
+// <sites>, at the insertion point of <builder>.
+inline void EmitValueProfile(IRBuilder<>& builder, GlobalVariable* sites,
+                             uint64_t index, Value* value) {
+  Module& mod = *builder.GetInsertBlock()->getModule();
+  LLVMContext& ctx = mod.getContext();
+
+  Function* profileF = cast<Function>(mod.getOrInsertFunction(
+        "profileValue",
+        Type::getVoidTy(ctx),
+        Type::getInt64PtrTy(ctx), /* site */
+        Type::getInt64Ty(ctx), /* value */
+        nullptr));
+
+  if (value->getType()->isPointerTy()) {
+    value = builder.CreatePtrToInt(value, builder.getInt64Ty());
+  } else {
+    value = builder.CreateZExtOrTrunc(value, builder.getInt64Ty());
+  }
+  builder.CreateCall(profileF, {
+      builder.CreateConstInBoundsGEP2_64(sites, 0, index * kValueSiteWords), value});
+}
+
+// Emits a module constructor that registers the value tables <sites> of
+// <kind> in <F> with the profile runtime.
+inline void EmitValueSiteRegistration(Function& F, prof_kind kind, GlobalVariable* sites) {
+  Module& mod = *F.getParent();
+  LLVMContext& ctx = mod.getContext();
+  uint64_t n = cast<ArrayType>(sites->getValueType())->getNumElements() / kValueSiteWords;
+
+  Function* registerF = cast<Function>(mod.getOrInsertFunction(
+        "registerValueSites",
+        Type::getVoidTy(ctx),
+        Type::getInt32Ty(ctx), /* kind */
+        Type::getInt64Ty(ctx), /* function hash */
+        Type::getInt64Ty(ctx), /* cfg checksum */
+        Type::getInt8PtrTy(ctx), /* name */
+        Type::getInt32Ty(ctx), /* number of sites */
+        Type::getInt64PtrTy(ctx), /* sites */
+        nullptr));
+
+  IRBuilder<> builder(&CreateRegistrationCtor(sites)->getEntryBlock());
+  builder.CreateCall(registerF, {
+      builder.getInt32(kind),
+      builder.getInt64(ProfileHash(F)), builder.getInt64(CFGChecksum(F)),
+      builder.CreateGlobalStringPtr(ProfileName(F)),
+      builder.getInt32(n),
+      builder.CreateConstInBoundsGEP2_64(sites, 0, 0)});
+  builder.CreateRetVoid();
+}
+
+// Emits a module constructor that registers the address of <F> with the
+// profile runtime, which records indirect calls to it by hash.
+inline void EmitFunctionAddressRegistration(Function& F) {
+  Module& mod = *F.getParent();
+  LLVMContext& ctx = mod.getContext();
+
+  Function* registerF = cast<Function>(mod.getOrInsertFunction(
+        "registerFunctionAddress",
+        Type::getVoidTy(ctx),
+        Type::getInt8PtrTy(ctx), /* address */
+        Type::getInt64Ty(ctx), /* function hash */
+        Type::getInt64Ty(ctx), /* cfg checksum */
+        Type::getInt8PtrTy(ctx), /* name */
+        nullptr));
+
+  IRBuilder<> builder(
+      &CreateRegistrationCtor(mod, "address." + F.getName())->getEntryBlock());
+  builder.CreateCall(registerF, {
+      builder.CreateBitCast(&F, builder.getInt8PtrTy()),
+      builder.getInt64(ProfileHash(F)), builder.getInt64(CFGChecksum(F)),
+      builder.CreateGlobalStringPtr(ProfileName(F))});
+  builder.CreateRetVoid();
+}
+
+}
+
+#endif
@@ -1,72 +1,28 @@
-#include "DataflowAnalysis.h"
+#include "LivenessAnalysis.h"
 #include "llvm/Pass.h"
+#include "llvm/IR/CFG.h"
 #include "llvm/IR/Function.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
 #include <map>
 #include <set>
 
 using namespace llvm;
 
-class LivenessInfo : public AnalysisInfo {
- public:
-  void add(int var) {
-    live_.insert(var);
-  }
-
-  void erase(int var) {
-    live_.erase(var);
-  }
-
-  size_t size() const {
-    return live_.size();
-  }
-
-  virtual void Print() {
-    for (std::set<int>::iterator it = live_.begin(); it != live_.end(); ++it) {
-      errs() << *it << '|';
-    }
-    errs() << '\n';
-  }
-
-  static LivenessInfo Bottom() {
-    return LivenessInfo();
-  }
-
-  static bool Equals(const LivenessInfo* info1, const LivenessInfo* info2) {
-    return info1->live_ == info2->live_;
-  }
-
-  static std::unique_ptr<LivenessInfo> Join(LivenessInfo* info1,
-      LivenessInfo* info2) {
-    std::unique_ptr<LivenessInfo> ret(new LivenessInfo(*info1));
+static cl::opt<bool> track_slots(
+    "liveness-slots",
+    cl::desc("Also track the liveness of stack slots, resolving pointers "
+             "with the pointer analysis"),
+    cl::init(false));
 
-    for (int var : info2->live_) {
-      ret->add(var);
-    }
-    return ret;
-  }
-
- private:
-  std::set<int> live_;
-};
-
-class LivenessAnalysis
-    : public DataFlowAnalysis<LivenessInfo, false /* Direction */> {
-
- public:
-  LivenessAnalysis()
-    : DataFlowAnalysis<LivenessInfo, false>(
-        LivenessInfo::Bottom(), LivenessInfo::Bottom()) { }
-
- private:
-  virtual void FlowFunction(
-      Instruction* I,
-      int inst_index,
-      const LivenessInfo& in,
-      const std::vector<Edge>& outs,
-      std::vector<LivenessInfo>& infos) const override;
-};
+static cl::opt<bool> ssa_liveness(
+    "liveness-ssa",
+    cl::desc("Compute the liveness of SSA values from their uses and print "
+             "the live-in and live-out sets of each block"),
+    cl::init(false));
 
 void LivenessAnalysis::FlowFunction(
       Instruction* I,
@@ -107,10 +63,10 @@ void LivenessAnalysis::FlowFunction(
 
         for (auto blk_it = phi->block_begin(); blk_it != phi->block_end(); ++blk_it) {
           if (*blk_it == outgoing_blk) {
-            Instruction* inst = cast<Instruction>(phi->getIncomingValue(val_index));
+            Instruction* inst = dyn_cast<Instruction>(phi->getIncomingValue(val_index));
             std::map<Instruction*, int>::const_iterator inst_mpit = inst_map_.find(inst);
 
-            if (inst_mpit != inst_map_.end()) {
+            if (inst != nullptr && inst_mpit != inst_map_.end()) {
               infos[i].add(inst_mpit->second);
             }
             break;
@@ -167,11 +123,11 @@ void LivenessAnalysis::FlowFunction(
          op_it != op_e; ++op_it) {
       Value* operand = op_it->get();
 
-      // evil hack, may not fall into type Instruction.
-      Instruction* inst = cast<Instruction>(operand);
+      // Arguments, constants and blocks are not tracked.
+      Instruction* inst = dyn_cast<Instruction>(operand);
       std::map<Instruction*, int>::const_iterator inst_mpit = inst_map_.find(inst);
 
-      if (inst_mpit != inst_map_.end()) {
+      if (inst != nullptr && inst_mpit != inst_map_.end()) {
         out.add(inst_mpit->second);
       }
     }
@@ -184,16 +140,232 @@ void LivenessAnalysis::FlowFunction(
   }
 }
 
+SlotLivenessAnalysis::SlotLivenessAnalysis(const StackSlots& slots)
+  : slots_(slots) { }
+
+void SlotLivenessAnalysis::FlowFunction(
+      Instruction* I,
+      int inst_index,
+      const LivenessInfo& in,
+      const std::vector<Edge>& outs,
+      std::vector<LivenessInfo>& infos) const {
+  LivenessAnalysis::FlowFunction(I, inst_index, in, outs, infos);
+
+  int kill = isa<StoreInst>(I) ? slots_.WholeSlot(I) : 0;
+  for (LivenessInfo& info : infos) {
+    if (kill != 0) {
+      info.erase(kill);
+    }
+    if (isa<LoadInst>(I)) {
+      for (int slot : slots_.Accessed(I)) {
+        info.add(slot);
+      }
+    }
+  }
+}
+
+void SSALivenessAnalysis::Run(Function* F) {
+  function_ = F;
+  insts_.assign(1, nullptr);
+  inst_map_.clear();
+  for (inst_iterator inst_it = inst_begin(F), inst_e = inst_end(F);
+       inst_it != inst_e; ++inst_it) {
+    inst_map_[&*inst_it] = insts_.size();
+    insts_.push_back(&*inst_it);
+  }
+
+  blocks_.clear();
+  block_map_.clear();
+  for (BasicBlock& block : *F) {
+    block_map_[&block] = blocks_.size();
+    blocks_.push_back(&block);
+  }
+  live_in_.assign(blocks_.size(), std::vector<int>());
+  live_out_.assign(blocks_.size(), std::vector<int>());
+
+  // Values are handled in index order, so remembering the last value a set
+  // took keeps the sets duplicate free and sorted.
+  std::vector<int> in_mark(blocks_.size(), 0), out_mark(blocks_.size(), 0);
+  std::vector<int> stack;
+
+  for (int value = 1; value < (int) insts_.size(); ++value) {
+    Instruction* def = insts_[value];
+    int def_block = block_map_[def->getParent()];
+
+    for (User* user : def->users()) {
+      Instruction* use = dyn_cast<Instruction>(user);
+      if (use == nullptr) {
+        continue;
+      }
+
+      if (PHINode* phi = dyn_cast<PHINode>(use)) {
+        for (unsigned i = 0; i < phi->getNumIncomingValues(); ++i) {
+          if (phi->getIncomingValue(i) != def) {
+            continue;
+          }
+          int pred = block_map_[phi->getIncomingBlock(i)];
+          if (out_mark[pred] != value) {
+            out_mark[pred] = value;
+            live_out_[pred].push_back(value);
+          }
+          stack.push_back(pred);
+        }
+      } else {
+        stack.push_back(block_map_[use->getParent()]);
+      }
+    }
+
+    // Up to the definition, which ends every path.
+    while (!stack.empty()) {
+      int cur = stack.back();
+      stack.pop_back();
+      if (cur == def_block || in_mark[cur] == value) {
+        continue;
+      }
+
+      in_mark[cur] = value;
+      live_in_[cur].push_back(value);
+      for (BasicBlock* pred : predecessors(blocks_[cur])) {
+        int pred_index = block_map_[pred];
+        if (out_mark[pred_index] != value) {
+          out_mark[pred_index] = value;
+          live_out_[pred_index].push_back(value);
+        }
+        stack.push_back(pred_index);
+      }
+    }
+  }
+}
+
+// Index of the last instruction before the point right after <I>.
+static int PointAfter(const SSALivenessAnalysis& liveness, Instruction* I) {
+  if (isa<PHINode>(I)) {
+    return liveness.IndexOf(I->getParent()->getFirstNonPHI()) - 1;
+  }
+  return liveness.IndexOf(I);
+}
+
+bool SSALivenessAnalysis::QueryFact(Instruction* I, int fact) const {
+  assert(IndexOf(I) != 0 && "instruction is not part of the analyzed function");
+
+  BasicBlock* block = I->getParent();
+  Instruction* def = insts_[fact];
+  int at = PointAfter(*this, I);
+
+  if (def->getParent() == block && fact > at) {
+    return false;
+  }
+  for (User* user : def->users()) {
+    Instruction* use = dyn_cast<Instruction>(user);
+    if (use != nullptr && !isa<PHINode>(use) && use->getParent() == block &&
+        IndexOf(use) > at) {
+      return true;
+    }
+  }
+
+  const std::vector<int>& out = LiveOut(block);
+  return std::binary_search(out.begin(), out.end(), fact);
+}
+
+LivenessInfo SSALivenessAnalysis::InputInfo(Instruction* I) const {
+  BasicBlock* block = I->getParent();
+  int at = PointAfter(*this, I);
+  LivenessInfo info;
+
+  for (int value : LiveOut(block)) {
+    info.add(value);
+  }
+  for (Instruction* cur = block->getTerminator(); IndexOf(cur) > at;
+       cur = cur->getPrevNode()) {
+    info.erase(IndexOf(cur));
+    for (Value* operand : cur->operands()) {
+      Instruction* inst = dyn_cast<Instruction>(operand);
+      if (inst != nullptr && IndexOf(inst) != 0) {
+        info.add(IndexOf(inst));
+      }
+    }
+  }
+  return info;
+}
+
+void SSALivenessAnalysis::Print() {
+  if (function_ == nullptr || !WantsResultsOf(function_->getName())) {
+    return;
+  }
+
+  raw_ostream& os = ResultStream();
+  BeginFunctionResults(function_->getName());
+  for (size_t i = 0; i < blocks_.size(); ++i) {
+    LivenessInfo in, out;
+    for (int value : live_in_[i]) {
+      in.add(value);
+    }
+    for (int value : live_out_[i]) {
+      out.add(value);
+    }
+
+    switch (GetResultFormat()) {
+      case RESULT_TEXT: {
+        os << "Block " << i << " in:";
+        in.Print();
+        os << "Block " << i << " out:";
+        out.Print();
+      } break;
+
+      case RESULT_JSONL: {
+        os << "{\"function\":";
+        WriteJSONString(os, function_->getName());
+        os << ",\"block\":" << i << ",\"in\":";
+        in.PrintJSON(os);
+        os << ",\"out\":";
+        out.PrintJSON(os);
+        os << "}\n";
+      } break;
+
+      case RESULT_BINARY: {
+        std::string record(1, 'B');
+        WriteVarint(record, i);
+        in.Serialize(record);
+        out.Serialize(record);
+        os << record;
+      } break;
+    }
+  }
+  FlushResultStream();
+}
+
 namespace {
 
 struct LivenessAnalysisPass : public FunctionPass {
   static char ID;
   LivenessAnalysisPass() : FunctionPass(ID) { }
 
+  void getAnalysisUsage(AnalysisUsage& AU) const override {
+    AU.addRequired<TargetLibraryInfoWrapperPass>();
+  }
+
   bool runOnFunction(Function& F) override {
+    if (ssa_liveness) {
+      SSALivenessAnalysis analyzer;
+      analyzer.Run(&F);
+      analyzer.Print();
+      return false;
+    }
+
+    if (track_slots) {
+      PointerAnalysis pointers(&getAnalysis<TargetLibraryInfoWrapperPass>().getTLI());
+      pointers.Solve(&F);
+
+      StackSlots slots(&F, pointers);
+      SlotLivenessAnalysis analyzer(slots);
+      analyzer.RunWorklistAlgorithm(&F);
+      analyzer.Print();
+      return false;
+    }
+
     LivenessAnalysis analyzer;
 
-    analyzer.RunWorklistAlgorithm(&F);
+    analyzer.RunCachedWorklistAlgorithm(&F, "liveness", 1 /* version */);
     analyzer.Print();
 
     return false;
@@ -0,0 +1,211 @@
+#ifndef LLVM_LIVENESS_ANALYSIS_H
+#define LLVM_LIVENESS_ANALYSIS_H
+
+#include "DataflowAnalysis.h"
+#include "PointerAnalysis.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/IR/Function.h"
+
+#include <map>
+#include <set>
+#include <vector>
+
+namespace llvm {
+
+class LivenessInfo : public AnalysisInfo {
+ public:
+  void add(int var) {
+    live_.insert(var);
+  }
+
+  void erase(int var) {
+    live_.erase(var);
+  }
+
+  bool contains(int var) const {
+    return live_.count(var) != 0;
+  }
+
+  size_t size() const {
+    return live_.size();
+  }
+
+  virtual void Print() {
+    for (std::set<int>::iterator it = live_.begin(); it != live_.end(); ++it) {
+      if (PointerInfo::IsSlot(*it)) {
+        ResultStream() << 'M' << (*it - 0x80000000) << '|';
+      } else {
+        ResultStream() << *it << '|';
+      }
+    }
+    ResultStream() << '\n';
+  }
+
+  // An array of the indices, slots as "M<n>" strings.
+  void PrintJSON(raw_ostream& os) const {
+    for (std::set<int>::const_iterator it = live_.begin(); it != live_.end(); ++it) {
+      os << (it == live_.begin() ? "[" : ",");
+      if (PointerInfo::IsSlot(*it)) {
+        os << "\"M" << (*it - 0x80000000) << '"';
+      } else {
+        os << *it;
+      }
+    }
+    os << (live_.empty() ? "[]" : "]");
+  }
+
+  // Sorted indices, delta encoded modulo 2^32. Slots are negative as int
+  // and sort first, so the delta to the first value wraps around.
+  void Serialize(std::string& out) const {
+    uint32_t prev = 0;
+
+    WriteVarint(out, live_.size());
+    for (int var : live_) {
+      WriteVarint(out, (uint32_t) var - prev);
+      prev = (uint32_t) var;
+    }
+  }
+
+  bool Deserialize(const char*& p, const char* end) {
+    uint64_t n, delta;
+    uint32_t var = 0;
+
+    if (!ReadVarint(p, end, n)) {
+      return false;
+    }
+    for (uint64_t i = 0; i < n; ++i) {
+      if (!ReadVarint(p, end, delta)) {
+        return false;
+      }
+      var += (uint32_t) delta;
+      add((int) var);
+    }
+    return true;
+  }
+
+  static LivenessInfo Bottom() {
+    return LivenessInfo();
+  }
+
+  static LivenessInfo Singleton(int var) {
+    LivenessInfo info;
+    info.add(var);
+    return info;
+  }
+
+  static bool Equals(const LivenessInfo* info1, const LivenessInfo* info2) {
+    return info1->live_ == info2->live_;
+  }
+
+  static std::unique_ptr<LivenessInfo> Join(LivenessInfo* info1,
+      LivenessInfo* info2) {
+    std::unique_ptr<LivenessInfo> ret(new LivenessInfo(*info1));
+
+    for (int var : info2->live_) {
+      ret->add(var);
+    }
+    return ret;
+  }
+
+ private:
+  std::set<int> live_;
+};
+
+class LivenessAnalysis
+    : public DataFlowAnalysis<LivenessInfo, false /* Direction */> {
+
+ public:
+  LivenessAnalysis()
+    : DataFlowAnalysis<LivenessInfo, false>(
+        LivenessInfo::Bottom(), LivenessInfo::Bottom()) { }
+
+ protected:
+  virtual void FlowFunction(
+      Instruction* I,
+      int inst_index,
+      const LivenessInfo& in,
+      const std::vector<Edge>& outs,
+      std::vector<LivenessInfo>& infos) const override;
+};
+
+// Liveness of stack slots on top of that of SSA values. A slot is live
+// where a load may still read what was stored to it; its fact is its
+// PointerAnalysis memory id, so slot and value facts never collide. Only
+// the slots <slots> tracks are. A load makes every slot it may read live,
+// and a store kills the slot it writes all of.
+class SlotLivenessAnalysis : public LivenessAnalysis {
+ public:
+  explicit SlotLivenessAnalysis(const StackSlots& slots);
+
+ protected:
+  virtual void FlowFunction(
+      Instruction* I,
+      int inst_index,
+      const LivenessInfo& in,
+      const std::vector<Edge>& outs,
+      std::vector<LivenessInfo>& infos) const override;
+
+ private:
+  const StackSlots& slots_;
+};
+
+// Liveness of SSA values computed from their uses instead of a fixpoint over
+// every edge: each use is walked backward to the definition block by block,
+// making the value live into each block on the way and live out of its
+// predecessors. A phi uses its incoming value at the end of the incoming
+// block. The work is linear in the size of the block live sets.
+//
+// Facts are instruction indices numbered like the dataflow analyses, and
+// queries are answered about the same points: right after an instruction,
+// or after all phis of the block for a phi.
+class SSALivenessAnalysis {
+ public:
+  SSALivenessAnalysis() : function_(nullptr) { }
+
+  void Run(Function* F);
+
+  // Index of <I> used in analysis facts, or 0 if <I> is unknown.
+  int IndexOf(Instruction* I) const {
+    std::map<Instruction*, int>::const_iterator it = inst_map_.find(I);
+    return it == inst_map_.end() ? 0 : it->second;
+  }
+
+  // The instruction of index <index>.
+  Instruction* InstructionAt(int index) const {
+    return insts_[index];
+  }
+
+  // Whether the value of instruction <fact> is live right after <I>. Only
+  // looks at the uses of the value in the block of <I> and at the live-out
+  // set of that block.
+  bool QueryFact(Instruction* I, int fact) const;
+
+  // All values live right after <I>.
+  LivenessInfo InputInfo(Instruction* I) const;
+
+  // Values live into and out of <block>, sorted by index.
+  const std::vector<int>& LiveIn(BasicBlock* block) const {
+    return live_in_[block_map_.lookup(block)];
+  }
+
+  const std::vector<int>& LiveOut(BasicBlock* block) const {
+    return live_out_[block_map_.lookup(block)];
+  }
+
+  // Prints the live-in and live-out set of every block in -result-format.
+  void Print();
+
+ private:
+  Function* function_;
+  std::vector<Instruction*> insts_;
+  std::map<Instruction*, int> inst_map_;
+
+  std::vector<BasicBlock*> blocks_;
+  DenseMap<BasicBlock*, int> block_map_;
+  std::vector<std::vector<int>> live_in_;
+  std::vector<std::vector<int>> live_out_;
+};
+
+}
+
+#endif
@@ -1,127 +1,25 @@
-#include "DataflowAnalysis.h"
+#include "PointerAnalysis.h"
 #include "llvm/Pass.h"
+#include "llvm/Analysis/MemoryBuiltins.h"
+#include "llvm/IR/DataLayout.h"
 #include "llvm/IR/Function.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <deque>
 #include <map>
 #include <set>
 #include <string>
 
 using namespace llvm;
 
-class PointerInfo : public AnalysisInfo {
- public:
-  std::string PrintPtrMem(int x) {
-    if (x > 0) {
-      return "R" + std::to_string(x);
-    } else {
-      return "M" + std::to_string(x - 0x80000000);
-    }
-  }
-
-  virtual void Print() {
-    for (std::map<int, std::set<int>>::iterator it = pointer_.begin();
-         it != pointer_.end(); ++it) {
-      errs() << PrintPtrMem(it->first) << "->(";
-      for (int x : it->second) {
-        errs() << PrintPtrMem(x) << '/';
-      }
-      errs() << ")|";
-    }
-    errs() << '\n';
-  }
-
-  void add(int R, int M) {
-    pointer_[R].insert(M);
-  }
-
-  // move <b> to <a>.
-  void move(int a, int b) {
-    if (a == b) return;
-
-    std::map<int, std::set<int>>::iterator it = pointer_.find(b);
-
-    if (it != pointer_.end()) {
-      std::set<int>& s = pointer_[a];
-
-      for (int x : it->second) {
-        s.insert(x);
-      }
-    }
-  }
-
-  // move all <x> in <b> to <a>.
-  void move2(int a, int b) {
-    std::map<int, std::set<int>>::iterator it = pointer_.find(b);
-
-    if (it != pointer_.end()) {
-      std::set<int> s_b = it->second;
-      for (int x : s_b) {
-        move(a, x);
-      }
-    }
-  }
-
-  // if a->x and b->y, add y->x.
-  void combine(int a, int b) {
-    std::map<int, std::set<int>>::iterator it_a = pointer_.find(a);
-    std::map<int, std::set<int>>::iterator it_b = pointer_.find(b);
-
-    if (it_a == pointer_.end() || it_b == pointer_.end()) {
-      return;
-    }
-    std::set<int> s_a = it_a->second;
-    std::set<int> s_b = it_b->second;
-
-    for (int y : s_b) {
-      std::set<int>& s = pointer_[y];
-
-      for (int x : s_a) {
-        s.insert(x);
-      }
-    }
-  }
-
-  static PointerInfo Bottom() {
-    return PointerInfo();
-  }
-
-  static bool Equals(const PointerInfo* info1, const PointerInfo* info2) {
-    return info1->pointer_ == info2->pointer_;
-  }
-
-  static std::unique_ptr<PointerInfo> Join(const PointerInfo* info1,
-      const PointerInfo* info2) {
-    std::unique_ptr<PointerInfo> ret(new PointerInfo(*info1));
-
-    for (const auto& pts : info2->pointer_) {
-      for (int y : pts.second) {
-        ret->add(pts.first, y);
-      }
-    }
-    return ret;
-  }
-
- private:
-  std::map<int, std::set<int>> pointer_;
-};
-
-class PointerAnalysis
-    : public DataFlowAnalysis<PointerInfo, true /* Direction */> {
-
- public:
-  PointerAnalysis()
-    : DataFlowAnalysis<PointerInfo, true>(
-        PointerInfo::Bottom(), PointerInfo::Bottom()) { }
-
- private:
-  virtual void FlowFunction(
-      Instruction* I,
-      int inst_index,
-      const PointerInfo& in,
-      const std::vector<Edge>& outs,
-      std::vector<PointerInfo>& infos) const override;
-};
+static cl::opt<bool> sparse_pointer(
+    "pointer-sparse",
+    cl::desc("Solve the pointer analysis sparsely, along def-use chains "
+             "instead of on every edge"),
+    cl::init(false));
 
 void PointerAnalysis::FlowFunction(
     Instruction* I,
@@ -135,12 +33,20 @@ void PointerAnalysis::FlowFunction(
   switch (I->getOpcode()) {
     // alloca.
     case Instruction::Alloca: {
-      out.add(inst_index, 0x80000000 + inst_index);
+      out.add(inst_index, PointerInfo::SlotOf(inst_index));
+    } break;
+
+    // malloc, calloc and operator new.
+    case Instruction::Call:
+    case Instruction::Invoke: {
+      if (IsHeapAllocation(I)) {
+        out.add(inst_index, PointerInfo::SlotOf(inst_index));
+      }
     } break;
 
     // bitcast.
     case Instruction::BitCast: {
-      Instruction* inst = cast<Instruction>(I->getOperand(0));
+      Instruction* inst = dyn_cast<Instruction>(I->getOperand(0));
       std::map<Instruction*, int>::const_iterator inst_mpit = inst_map_.find(inst);
 
       if (inst_mpit != inst_map_.end()) {
@@ -152,7 +58,7 @@ void PointerAnalysis::FlowFunction(
     case Instruction::GetElementPtr: {
       GetElementPtrInst* inst = cast<GetElementPtrInst>(I);
       std::map<Instruction*, int>::const_iterator inst_mpit = inst_map_.find(
-          cast<Instruction>(inst->getPointerOperand()));
+          dyn_cast<Instruction>(inst->getPointerOperand()));
 
       if (inst_mpit != inst_map_.end()) {
         out.move(inst_index, inst_mpit->second);
@@ -163,7 +69,7 @@ void PointerAnalysis::FlowFunction(
     case Instruction::Load: {
       LoadInst* inst = cast<LoadInst>(I);
       std::map<Instruction*, int>::const_iterator inst_mpit = inst_map_.find(
-          cast<Instruction>(inst->getPointerOperand()));
+          dyn_cast<Instruction>(inst->getPointerOperand()));
 
       if (inst_mpit != inst_map_.end()) {
         out.move2(inst_index, inst_mpit->second);
@@ -174,9 +80,9 @@ void PointerAnalysis::FlowFunction(
     case Instruction::Store: {
       StoreInst* inst = cast<StoreInst>(I);
       std::map<Instruction*, int>::const_iterator inst_mpit1 = inst_map_.find(
-          cast<Instruction>(inst->getPointerOperand()));
+          dyn_cast<Instruction>(inst->getPointerOperand()));
       std::map<Instruction*, int>::const_iterator inst_mpit2 = inst_map_.find(
-          cast<Instruction>(inst->getValueOperand()));
+          dyn_cast<Instruction>(inst->getValueOperand()));
 
       if (inst_mpit1 != inst_map_.end() && inst_mpit2 != inst_map_.end()) {
         out.combine(inst_mpit2->second, inst_mpit1->second);
@@ -188,12 +94,12 @@ void PointerAnalysis::FlowFunction(
       SelectInst* inst = cast<SelectInst>(I);
       std::map<Instruction*, int>::const_iterator inst_mpit;
 
-      inst_mpit = inst_map_.find(cast<Instruction>(inst->getTrueValue()));
+      inst_mpit = inst_map_.find(dyn_cast<Instruction>(inst->getTrueValue()));
       if (inst_mpit != inst_map_.end()) {
         out.move(inst_index, inst_mpit->second);
       }
 
-      inst_mpit = inst_map_.find(cast<Instruction>(inst->getFalseValue()));
+      inst_mpit = inst_map_.find(dyn_cast<Instruction>(inst->getFalseValue()));
       if (inst_mpit != inst_map_.end()) {
         out.move(inst_index, inst_mpit->second);
       }
@@ -220,7 +126,7 @@ void PointerAnalysis::FlowFunction(
         int val_index = 0;
 
         for (auto blk_it = phi->block_begin(); blk_it != phi->block_end(); ++blk_it) {
-          Instruction* inst = cast<Instruction>(phi->getIncomingValue(val_index));
+          Instruction* inst = dyn_cast<Instruction>(phi->getIncomingValue(val_index));
           std::map<Instruction*, int>::const_iterator inst_mpit = inst_map_.find(inst);
 
           if (inst_mpit != inst_map_.end()) {
@@ -239,16 +145,550 @@ void PointerAnalysis::FlowFunction(
   }
 }
 
+std::set<int> PointerAnalysis::PointsTo(Instruction* at, Value* ptr) {
+  Instruction* inst = dyn_cast<Instruction>(ptr);
+  int index = inst == nullptr ? 0 : IndexOf(inst);
+  if (index == 0) {
+    return std::set<int>();
+  }
+  if (sparse_) {
+    return SparseIn(index, IndexOf(at));
+  }
+
+  std::set<int> pts;
+  for (const Edge& in : in_edges_[IndexOf(at)]) {
+    const std::set<int>* in_pts = edges_[in.second].Lookup(index);
+    if (in_pts != nullptr) {
+      pts.insert(in_pts->begin(), in_pts->end());
+    }
+  }
+  return pts;
+}
+
+void PointerAnalysis::Solve(Function* F) {
+  if (sparse_pointer) {
+    RunSparse(F);
+  } else {
+    RunCachedWorklistAlgorithm(F, "pointer", 2 /* version */);
+  }
+}
+
+// Adds <from> to <into>, returns whether <into> grew.
+static bool Merge(std::set<int>& into, const std::set<int>& from) {
+  size_t size = into.size();
+  if (&into != &from) {
+    into.insert(from.begin(), from.end());
+  }
+  return into.size() != size;
+}
+
+static bool Intersects(const std::set<int>& a, const std::set<int>& b) {
+  for (int x : a) {
+    if (b.count(x)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool PointerAnalysis::Reaches(int from, int to) const {
+  Instruction* src = insts_[from];
+  Instruction* dst = insts_[to];
+
+  // Phis but the first have no edges, the first one computes them all.
+  for (Instruction* I : {src, dst}) {
+    if (isa<PHINode>(I) && I != &I->getParent()->front()) {
+      return false;
+    }
+  }
+  if (src->getParent() == dst->getParent() && from < to) {
+    return true;
+  }
+  return block_reach_[block_index_.lookup(src->getParent())].test(
+      block_index_.lookup(dst->getParent()));
+}
+
+const std::set<int>& PointerAnalysis::SparseIn(int value, int at) const {
+  static const std::set<int> none;
+  return value != 0 && Reaches(def_node_[value], at) ? sparse_pts_[value] : none;
+}
+
+std::set<int> PointerAnalysis::SparseEvaluate(int index) const {
+  Instruction* I = insts_[index];
+  int at = def_node_[index];
+  std::set<int> pts;
+
+  if (isa<AllocaInst>(I) || IsHeapAllocation(I)) {
+    pts.insert(PointerInfo::SlotOf(index));
+  } else if (isa<BitCastInst>(I) || isa<GetElementPtrInst>(I)) {
+    Merge(pts, SparseIn(IndexOf(dyn_cast<Instruction>(I->getOperand(0))), at));
+  } else if (SelectInst* select = dyn_cast<SelectInst>(I)) {
+    Merge(pts, SparseIn(IndexOf(dyn_cast<Instruction>(select->getTrueValue())), at));
+    Merge(pts, SparseIn(IndexOf(dyn_cast<Instruction>(select->getFalseValue())), at));
+  } else if (PHINode* phi = dyn_cast<PHINode>(I)) {
+    for (Value* incoming : phi->incoming_values()) {
+      Merge(pts, SparseIn(IndexOf(dyn_cast<Instruction>(incoming)), at));
+    }
+  } else if (LoadInst* load = dyn_cast<LoadInst>(I)) {
+    const std::set<int>& from = SparseIn(
+        IndexOf(dyn_cast<Instruction>(load->getPointerOperand())), at);
+    std::map<int, std::vector<int>>::const_iterator it = load_stores_.find(index);
+    if (from.empty() || it == load_stores_.end()) {
+      return pts;
+    }
+
+    // What a store put into memory the load reads.
+    for (int store_index : it->second) {
+      StoreInst* store = cast<StoreInst>(insts_[store_index]);
+      const std::set<int>& into = SparseIn(
+          IndexOf(dyn_cast<Instruction>(store->getPointerOperand())), store_index);
+      if (Intersects(from, into)) {
+        Merge(pts, SparseIn(
+            IndexOf(dyn_cast<Instruction>(store->getValueOperand())), store_index));
+      }
+    }
+  }
+  return pts;
+}
+
+void PointerAnalysis::RunSparse(Function* F) {
+  ResetGraph();
+  AssignIndexToInst(F);
+  sparse_ = true;
+
+  int n = insts_.size();
+  def_node_.assign(n, 0);
+  sparse_pts_.assign(n, std::set<int>());
+  load_stores_.clear();
+  store_loads_.clear();
+
+  // Blocks reachable from each block over at least one edge, solved
+  // backward from the successors.
+  std::vector<BasicBlock*> blocks;
+  block_index_.clear();
+  for (BasicBlock& block : *F) {
+    block_index_[&block] = blocks.size();
+    blocks.push_back(&block);
+  }
+  block_reach_.assign(blocks.size(), BitVector(blocks.size()));
+  for (bool changed = true; changed; ) {
+    changed = false;
+    for (int b = blocks.size() - 1; b >= 0; --b) {
+      BitVector reach(blocks.size());
+      for (BasicBlock* succ : successors(blocks[b])) {
+        int s = block_index_[succ];
+        reach.set(s);
+        reach |= block_reach_[s];
+      }
+      if (reach != block_reach_[b]) {
+        block_reach_[b] = reach;
+        changed = true;
+      }
+    }
+  }
+
+  for (int i = 1; i < n; ++i) {
+    Instruction* I = insts_[i];
+    def_node_[i] = isa<PHINode>(I) ? IndexOf(&I->getParent()->front()) : i;
+  }
+
+  // Flow-insensitive pre-analysis: what each value and memory id may point
+  // to anywhere, to tell which stores a load may read from.
+  std::vector<std::set<int>> pre(n);
+  std::map<int, std::set<int>> pre_memory;
+  auto pre_of = [&](Value* V) -> std::set<int>& {
+    return pre[IndexOf(dyn_cast<Instruction>(V))];
+  };
+
+  for (bool changed = true; changed; ) {
+    changed = false;
+    for (int i = 1; i < n; ++i) {
+      Instruction* I = insts_[i];
+
+      if (isa<AllocaInst>(I) || IsHeapAllocation(I)) {
+        changed |= pre[i].insert(PointerInfo::SlotOf(i)).second;
+      } else if (isa<BitCastInst>(I) || isa<GetElementPtrInst>(I)) {
+        changed |= Merge(pre[i], pre_of(I->getOperand(0)));
+      } else if (SelectInst* select = dyn_cast<SelectInst>(I)) {
+        changed |= Merge(pre[i], pre_of(select->getTrueValue()));
+        changed |= Merge(pre[i], pre_of(select->getFalseValue()));
+      } else if (PHINode* phi = dyn_cast<PHINode>(I)) {
+        for (Value* incoming : phi->incoming_values()) {
+          changed |= Merge(pre[i], pre_of(incoming));
+        }
+      } else if (LoadInst* load = dyn_cast<LoadInst>(I)) {
+        for (int x : pre_of(load->getPointerOperand())) {
+          changed |= Merge(pre[i], pre_memory[x]);
+        }
+      } else if (StoreInst* store = dyn_cast<StoreInst>(I)) {
+        for (int y : pre_of(store->getPointerOperand())) {
+          changed |= Merge(pre_memory[y], pre_of(store->getValueOperand()));
+        }
+      }
+    }
+  }
+
+  // Memory def-use chains: the stores that may write what a load may read,
+  // and reach the load.
+  std::map<int, std::vector<int>> stores_into;
+  for (int i = 1; i < n; ++i) {
+    if (StoreInst* store = dyn_cast<StoreInst>(insts_[i])) {
+      for (int y : pre_of(store->getPointerOperand())) {
+        stores_into[y].push_back(i);
+      }
+    }
+  }
+  for (int i = 1; i < n; ++i) {
+    LoadInst* load = dyn_cast<LoadInst>(insts_[i]);
+    if (load == nullptr) {
+      continue;
+    }
+
+    std::set<int> stores;
+    for (int x : pre_of(load->getPointerOperand())) {
+      for (int store_index : stores_into[x]) {
+        if (Reaches(store_index, i)) {
+          stores.insert(store_index);
+        }
+      }
+    }
+    for (int store_index : stores) {
+      load_stores_[i].push_back(store_index);
+      store_loads_[store_index].push_back(i);
+    }
+  }
+
+  // Propagate along SSA uses and memory chains.
+  std::deque<int> worklist;
+  std::vector<bool> queued(n, true);
+  for (int i = 1; i < n; ++i) {
+    worklist.push_back(i);
+  }
+  queued[0] = false;
+
+  auto push = [&](int index) {
+    if (!queued[index]) {
+      queued[index] = true;
+      worklist.push_back(index);
+    }
+  };
+
+  while (!worklist.empty()) {
+    int cur = worklist.front();
+    worklist.pop_front();
+    queued[cur] = false;
+
+    // Inputs only grow, so the set does too.
+    std::set<int> pts = SparseEvaluate(cur);
+    if (pts.size() == sparse_pts_[cur].size()) {
+      continue;
+    }
+    sparse_pts_[cur] = pts;
+
+    for (User* user : insts_[cur]->users()) {
+      int user_index = IndexOf(dyn_cast<Instruction>(user));
+      if (user_index == 0) {
+        continue;
+      }
+      if (isa<StoreInst>(user)) {
+        for (int load_index : store_loads_[user_index]) {
+          push(load_index);
+        }
+      } else {
+        push(user_index);
+      }
+    }
+  }
+}
+
+PointerInfo PointerAnalysis::SparseOut(int node) const {
+  PointerInfo out;
+  if (node == 0) {
+    return out;
+  }
+
+  for (int i = 1; i < (int) insts_.size(); ++i) {
+    if (def_node_[i] != node && !Reaches(def_node_[i], node)) {
+      continue;
+    }
+    for (int x : sparse_pts_[i]) {
+      out.add(i, x);
+    }
+
+    StoreInst* store = dyn_cast<StoreInst>(insts_[i]);
+    if (store == nullptr) {
+      continue;
+    }
+    const std::set<int>& into = SparseIn(
+        IndexOf(dyn_cast<Instruction>(store->getPointerOperand())), i);
+    const std::set<int>& value = SparseIn(
+        IndexOf(dyn_cast<Instruction>(store->getValueOperand())), i);
+    for (int y : into) {
+      for (int x : value) {
+        out.add(y, x);
+      }
+    }
+  }
+  return out;
+}
+
+void PointerAnalysis::Print() {
+  if (!sparse_) {
+    DataFlowAnalysis<PointerInfo, true>::Print();
+    return;
+  }
+
+  if (function_ == nullptr || !WantsResultsOf(function_->getName())) {
+    return;
+  }
+
+  // The edges are only built to be printed.
+  if (out_edges_.empty()) {
+    BuildGraph(function_);
+  }
+  BeginFunctionResults(function_->getName());
+  for (std::map<int, std::vector<Edge>>::iterator it = out_edges_.begin();
+       it != out_edges_.end(); ++it) {
+    PointerInfo out = SparseOut(it->first);
+    for (const Edge& e : it->second) {
+      PrintEdge(it->first, e.first, out);
+    }
+  }
+  FlushResultStream();
+}
+
+bool PointerAnalysis::IsHeapAllocation(const Instruction* I) const {
+  return TLI_ != nullptr && (isMallocLikeFn(I, TLI_) || isCallocLikeFn(I, TLI_));
+}
+
+bool PointerAnalysis::IsHeapFree(const Instruction* I) const {
+  return TLI_ != nullptr && isFreeCall(I, TLI_) != nullptr;
+}
+
+// Whether the pointer analysis follows the address in operand <op> of <I>
+// to wherever it goes next. Stored addresses are dealt with separately.
+static bool IsFollowedUse(Instruction* I, unsigned op, const PointerAnalysis& pointers) {
+  if (pointers.IsHeapFree(I)) {
+    return op == 0;
+  }
+
+  switch (I->getOpcode()) {
+    case Instruction::Load:
+      return true;
+    case Instruction::Store:
+      return op == 1;
+    case Instruction::BitCast:
+    case Instruction::GetElementPtr:
+      return op == 0;
+    case Instruction::Select:
+      return op != 0;
+    case Instruction::PHI:
+    case Instruction::ICmp:
+      return true;
+    default: {
+      IntrinsicInst* intrinsic = dyn_cast<IntrinsicInst>(I);
+      return intrinsic != nullptr &&
+             (intrinsic->getIntrinsicID() == Intrinsic::lifetime_start ||
+              intrinsic->getIntrinsicID() == Intrinsic::lifetime_end);
+    }
+  }
+}
+
+StackSlots::StackSlots(Function* F, PointerAnalysis& pointers) {
+  const DataLayout& DL = F->getParent()->getDataLayout();
+
+  auto points_to = [&](Instruction* at, Value* V) {
+    return pointers.PointsTo(at, V);
+  };
+
+  // Slots whose address goes where the pointer analysis does not follow
+  // it escape, and so do the addresses stored in them.
+  std::set<int> escaped;
+  std::vector<std::pair<std::set<int>, std::set<int>>> stored; // <addresses, into>
+  std::vector<StoreInst*> stores;
+
+  for (inst_iterator inst_it = inst_begin(F), inst_e = inst_end(F);
+       inst_it != inst_e; ++inst_it) {
+    Instruction* I = &*inst_it;
+
+    if (isa<AllocaInst>(I) || pointers.IsHeapAllocation(I)) {
+      tracked_.insert(PointerInfo::SlotOf(pointers.IndexOf(I)));
+    }
+    if (StoreInst* store = dyn_cast<StoreInst>(I)) {
+      stores.push_back(store);
+    }
+
+    for (unsigned op = 0; op < I->getNumOperands(); ++op) {
+      std::set<int> pts = points_to(I, I->getOperand(op));
+      if (pts.empty() || IsFollowedUse(I, op, pointers)) {
+        continue;
+      }
+
+      std::set<int> into;
+      if (isa<StoreInst>(I)) {
+        into = points_to(I, cast<StoreInst>(I)->getPointerOperand());
+      }
+      if (into.empty()) {
+        escaped.insert(pts.begin(), pts.end());
+      } else {
+        stored.push_back(std::make_pair(pts, into));
+      }
+    }
+  }
+
+  for (bool changed = true; changed; ) {
+    changed = false;
+    for (const auto& s : stored) {
+      bool leaks = false;
+      for (int slot : s.second) {
+        leaks |= escaped.count(slot) != 0;
+      }
+      for (int slot : s.first) {
+        if (leaks && escaped.insert(slot).second) {
+          changed = true;
+        }
+      }
+    }
+  }
+  for (int slot : escaped) {
+    tracked_.erase(slot);
+  }
+
+  // Pointers that point into tracked slots and nowhere else, the greatest
+  // fixpoint of: tracked allocations, and casts, offsets, phis and selects of
+  // such pointers, and loads of tracked slots that only ever hold them.
+  std::set<Value*> into_slots;
+  for (inst_iterator inst_it = inst_begin(F), inst_e = inst_end(F);
+       inst_it != inst_e; ++inst_it) {
+    Instruction* I = &*inst_it;
+    if (I->getType()->isPointerTy() &&
+        (isa<AllocaInst>(I) || pointers.IsHeapAllocation(I) ||
+         isa<BitCastInst>(I) || isa<GetElementPtrInst>(I) ||
+         isa<PHINode>(I) || isa<SelectInst>(I) || isa<LoadInst>(I))) {
+      into_slots.insert(I);
+    }
+  }
+
+  for (bool changed = true; changed; ) {
+    changed = false;
+    for (std::set<Value*>::iterator it = into_slots.begin(); it != into_slots.end(); ) {
+      Instruction* I = cast<Instruction>(*it);
+      bool holds = true;
+
+      if (isa<AllocaInst>(I) || pointers.IsHeapAllocation(I)) {
+        holds = IsTracked(PointerInfo::SlotOf(pointers.IndexOf(I)));
+      } else if (isa<BitCastInst>(I) || isa<GetElementPtrInst>(I)) {
+        holds = into_slots.count(I->getOperand(0)) != 0;
+      } else if (isa<SelectInst>(I)) {
+        holds = into_slots.count(I->getOperand(1)) && into_slots.count(I->getOperand(2));
+      } else if (PHINode* phi = dyn_cast<PHINode>(I)) {
+        for (Value* incoming : phi->incoming_values()) {
+          holds &= into_slots.count(incoming) != 0;
+        }
+      } else {
+        std::set<int> from = points_to(I, cast<LoadInst>(I)->getPointerOperand());
+        holds = !from.empty();
+        for (int slot : from) {
+          holds &= IsTracked(slot);
+        }
+        for (size_t i = 0; holds && i < stores.size(); ++i) {
+          std::set<int> to = points_to(stores[i], stores[i]->getPointerOperand());
+          for (int slot : to) {
+            if (from.count(slot)) {
+              holds &= into_slots.count(stores[i]->getValueOperand()) != 0;
+            }
+          }
+        }
+      }
+
+      if (holds) {
+        ++it;
+      } else {
+        it = into_slots.erase(it);
+        changed = true;
+      }
+    }
+  }
+
+  for (inst_iterator inst_it = inst_begin(F), inst_e = inst_end(F);
+       inst_it != inst_e; ++inst_it) {
+    Instruction* I = &*inst_it;
+    Value* ptr;
+    Type* type;
+
+    if (LoadInst* load = dyn_cast<LoadInst>(I)) {
+      ptr = load->getPointerOperand();
+      type = load->getType();
+      if (load->isSimple() && into_slots.count(ptr)) {
+        only_slots_.insert(I);
+      }
+    } else if (StoreInst* store = dyn_cast<StoreInst>(I)) {
+      ptr = store->getPointerOperand();
+      type = store->getValueOperand()->getType();
+      if (store->isSimple() && into_slots.count(ptr)) {
+        only_slots_.insert(I);
+      }
+    } else if (pointers.IsHeapFree(I)) {
+      ptr = I->getOperand(0);
+      type = nullptr;
+      if (into_slots.count(ptr)) {
+        only_slots_.insert(I);
+      }
+    } else {
+      continue;
+    }
+
+    std::set<int> pts = points_to(I, ptr);
+    for (int slot : pts) {
+      if (IsTracked(slot)) {
+        accessed_[I].insert(slot);
+      }
+    }
+
+    // An access as large as the slot covers all of it; one through a
+    // pointer that can only point to that slot is at its start. A free
+    // neither reads nor writes the slot.
+    if (type == nullptr) {
+      continue;
+    }
+    AllocaInst* alloca = dyn_cast<AllocaInst>(ptr->stripPointerCasts());
+    if (alloca == nullptr && only_slots_.count(I) && pts.size() == 1) {
+      alloca = dyn_cast<AllocaInst>(pointers.InstructionAt(
+          PointerInfo::IndexOfSlot(*pts.begin())));
+    }
+    if (alloca != nullptr && !alloca->isArrayAllocation() &&
+        IsTracked(PointerInfo::SlotOf(pointers.IndexOf(alloca))) &&
+        DL.getTypeStoreSize(type) >= DL.getTypeAllocSize(alloca->getAllocatedType())) {
+      whole_[I] = PointerInfo::SlotOf(pointers.IndexOf(alloca));
+    }
+  }
+}
+
+const std::set<int>& StackSlots::Accessed(Instruction* I) const {
+  static const std::set<int> none;
+  std::map<Instruction*, std::set<int>>::const_iterator it = accessed_.find(I);
+  return it == accessed_.end() ? none : it->second;
+}
+
+int StackSlots::WholeSlot(Instruction* I) const {
+  std::map<Instruction*, int>::const_iterator it = whole_.find(I);
+  return it == whole_.end() ? 0 : it->second;
+}
+
 namespace {
 
 struct PointerAnalysisPass : public FunctionPass {
   static char ID;
   PointerAnalysisPass() : FunctionPass(ID) { }
 
+  void getAnalysisUsage(AnalysisUsage& AU) const override {
+    AU.addRequired<TargetLibraryInfoWrapperPass>();
+  }
+
   bool runOnFunction(Function& F) override {
-    PointerAnalysis analyzer;
+    PointerAnalysis analyzer(&getAnalysis<TargetLibraryInfoWrapperPass>().getTLI());
 
-    analyzer.RunWorklistAlgorithm(&F);
+    analyzer.Solve(&F);
     analyzer.Print();
 
     return false;
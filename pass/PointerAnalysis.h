@@ -0,0 +1,293 @@
+#ifndef LLVM_POINTER_ANALYSIS_H
+#define LLVM_POINTER_ANALYSIS_H
+
+#include "DataflowAnalysis.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/IR/Function.h"
+
+#include <map>
+#include <set>
+#include <string>
+
+namespace llvm {
+
+class PointerInfo : public AnalysisInfo {
+ public:
+  static std::string PrintPtrMem(int x) {
+    if (x > 0) {
+      return "R" + std::to_string(x);
+    } else {
+      return "M" + std::to_string(x - 0x80000000);
+    }
+  }
+
+  virtual void Print() {
+    for (std::map<int, std::set<int>>::iterator it = pointer_.begin();
+         it != pointer_.end(); ++it) {
+      ResultStream() << PrintPtrMem(it->first) << "->(";
+      for (int x : it->second) {
+        ResultStream() << PrintPtrMem(x) << '/';
+      }
+      ResultStream() << ")|";
+    }
+    ResultStream() << '\n';
+  }
+
+  // An object from each pointer or memory id to the ids it points to.
+  void PrintJSON(raw_ostream& os) const {
+    os << '{';
+    for (std::map<int, std::set<int>>::const_iterator it = pointer_.begin();
+         it != pointer_.end(); ++it) {
+      os << (it == pointer_.begin() ? "" : ",") << '"' << PrintPtrMem(it->first) << "\":[";
+      for (std::set<int>::const_iterator x = it->second.begin(); x != it->second.end(); ++x) {
+        os << (x == it->second.begin() ? "" : ",") << '"' << PrintPtrMem(*x) << '"';
+      }
+      os << ']';
+    }
+    os << '}';
+  }
+
+  // Pointer and memory ids are written as unsigned, memory ids have the top
+  // bit set.
+  void Serialize(std::string& out) const {
+    WriteVarint(out, pointer_.size());
+    for (const auto& pts : pointer_) {
+      WriteVarint(out, (uint32_t) pts.first);
+      WriteVarint(out, pts.second.size());
+      for (int x : pts.second) {
+        WriteVarint(out, (uint32_t) x);
+      }
+    }
+  }
+
+  bool Deserialize(const char*& p, const char* end) {
+    uint64_t n, m, x, y;
+
+    if (!ReadVarint(p, end, n)) {
+      return false;
+    }
+    for (uint64_t i = 0; i < n; ++i) {
+      if (!ReadVarint(p, end, x) || !ReadVarint(p, end, m)) {
+        return false;
+      }
+      for (uint64_t j = 0; j < m; ++j) {
+        if (!ReadVarint(p, end, y)) {
+          return false;
+        }
+        add((int) x, (int) y);
+      }
+    }
+    return true;
+  }
+
+  // Memory id of the stack slot or heap object allocated by the instruction
+  // <index>.
+  static int SlotOf(int index) {
+    return 0x80000000 + index;
+  }
+
+  static bool IsSlot(int x) {
+    return x < 0;
+  }
+
+  // Index of the instruction that allocated the stack slot or heap object
+  // <slot>.
+  static int IndexOfSlot(int slot) {
+    return slot - 0x80000000;
+  }
+
+  // What <R> points to, or null if nothing.
+  const std::set<int>* Lookup(int R) const {
+    std::map<int, std::set<int>>::const_iterator it = pointer_.find(R);
+    return it == pointer_.end() ? nullptr : &it->second;
+  }
+
+  void add(int R, int M) {
+    pointer_[R].insert(M);
+  }
+
+  // move <b> to <a>.
+  void move(int a, int b) {
+    if (a == b) return;
+
+    std::map<int, std::set<int>>::iterator it = pointer_.find(b);
+
+    if (it != pointer_.end()) {
+      std::set<int>& s = pointer_[a];
+
+      for (int x : it->second) {
+        s.insert(x);
+      }
+    }
+  }
+
+  // move all <x> in <b> to <a>.
+  void move2(int a, int b) {
+    std::map<int, std::set<int>>::iterator it = pointer_.find(b);
+
+    if (it != pointer_.end()) {
+      std::set<int> s_b = it->second;
+      for (int x : s_b) {
+        move(a, x);
+      }
+    }
+  }
+
+  // if a->x and b->y, add y->x.
+  void combine(int a, int b) {
+    std::map<int, std::set<int>>::iterator it_a = pointer_.find(a);
+    std::map<int, std::set<int>>::iterator it_b = pointer_.find(b);
+
+    if (it_a == pointer_.end() || it_b == pointer_.end()) {
+      return;
+    }
+    std::set<int> s_a = it_a->second;
+    std::set<int> s_b = it_b->second;
+
+    for (int y : s_b) {
+      std::set<int>& s = pointer_[y];
+
+      for (int x : s_a) {
+        s.insert(x);
+      }
+    }
+  }
+
+  static PointerInfo Bottom() {
+    return PointerInfo();
+  }
+
+  static bool Equals(const PointerInfo* info1, const PointerInfo* info2) {
+    return info1->pointer_ == info2->pointer_;
+  }
+
+  static std::unique_ptr<PointerInfo> Join(const PointerInfo* info1,
+      const PointerInfo* info2) {
+    std::unique_ptr<PointerInfo> ret(new PointerInfo(*info1));
+
+    for (const auto& pts : info2->pointer_) {
+      for (int y : pts.second) {
+        ret->add(pts.first, y);
+      }
+    }
+    return ret;
+  }
+
+ private:
+  std::map<int, std::set<int>> pointer_;
+};
+
+class PointerAnalysis
+    : public DataFlowAnalysis<PointerInfo, true /* Direction */> {
+
+ public:
+  // With <TLI>, the results of malloc, calloc and operator new calls are
+  // modeled as objects too, named by the memory id of the call.
+  explicit PointerAnalysis(const TargetLibraryInfo* TLI = nullptr)
+    : DataFlowAnalysis<PointerInfo, true>(
+        PointerInfo::Bottom(), PointerInfo::Bottom()),
+      TLI_(TLI), sparse_(false) { }
+
+  // Solves the analysis on <F>: sparsely with -pointer-sparse, else with
+  // the (cached) worklist algorithm.
+  void Solve(Function* F);
+
+  // Solves the analysis on <F> without facts on edges. A flow-insensitive
+  // pre-analysis links each load to the stores that may write what it
+  // reads and can reach it; points-to sets of values are then propagated
+  // along SSA uses and those links only. The fixpoint has no strong
+  // updates, so a value points to the same set wherever its definition
+  // reaches, and memory holds what every reaching store put there; the
+  // answers are those of the worklist algorithm. Only PointsTo(), IndexOf(),
+  // InstructionAt() and Print() are available afterwards.
+  void RunSparse(Function* F);
+
+  // Memory ids <ptr> may point to right before <at>, in a solved analysis.
+  // Empty if the analysis does not know what <ptr> points to.
+  std::set<int> PointsTo(Instruction* at, Value* ptr);
+
+  // Whether <I> allocates a heap object the analysis models.
+  bool IsHeapAllocation(const Instruction* I) const;
+
+  // Whether <I> releases the heap object its first argument points to.
+  bool IsHeapFree(const Instruction* I) const;
+
+  // Prints the facts of every edge, also when solved sparsely.
+  void Print();
+
+ private:
+  virtual void FlowFunction(
+      Instruction* I,
+      int inst_index,
+      const PointerInfo& in,
+      const std::vector<Edge>& outs,
+      std::vector<PointerInfo>& infos) const override;
+
+  // Whether a path of at least one edge leads from node <from> to node <to>.
+  bool Reaches(int from, int to) const;
+
+  // Points-to set of the value of node <value> right before node <at>.
+  const std::set<int>& SparseIn(int value, int at) const;
+
+  // Recomputes the points-to set of the value of node <index>.
+  std::set<int> SparseEvaluate(int index) const;
+
+  // Facts on the outgoing edges of node <node>.
+  PointerInfo SparseOut(int node) const;
+
+  const TargetLibraryInfo* TLI_;
+
+  // Sparse solution: points-to set of each value, the node computing it
+  // (the first phi of the block for phis), and for each load the stores it
+  // may read from.
+  bool sparse_;
+  std::vector<std::set<int>> sparse_pts_;
+  std::vector<int> def_node_;
+  std::map<int, std::vector<int>> load_stores_;
+  std::map<int, std::vector<int>> store_loads_;
+  DenseMap<BasicBlock*, int> block_index_;
+  std::vector<BitVector> block_reach_;
+};
+
+// How the loads and stores of a function access its stack slots, resolved
+// with a solved PointerAnalysis. Slots are named by their memory ids; the
+// heap objects the analysis models are slots too.
+//
+// Only slots whose address the pointer analysis follows everywhere are
+// tracked: it may be cast, offset, merged by phis and selects, compared,
+// stored into other tracked slots and freed, but a slot whose address
+// reaches a call, a return or unknown memory escapes: it may be accessed by
+// code the analysis does not see.
+class StackSlots {
+ public:
+  // <pointers> must be solved on <F>.
+  StackSlots(Function* F, PointerAnalysis& pointers);
+
+  bool IsTracked(int slot) const {
+    return tracked_.count(slot) != 0;
+  }
+
+  // The tracked slots the load, store or free <I> may access.
+  const std::set<int>& Accessed(Instruction* I) const;
+
+  // Whether the simple load or store, or the free <I> accesses nothing but
+  // tracked slots.
+  bool OnlySlots(Instruction* I) const {
+    return only_slots_.count(I) != 0;
+  }
+
+  // The slot the load or store <I> accesses all of, or 0 if none.
+  int WholeSlot(Instruction* I) const;
+
+ private:
+  std::set<int> tracked_;
+  std::map<Instruction*, std::set<int>> accessed_;
+  std::set<Instruction*> only_slots_;
+  std::map<Instruction*, int> whole_;
+};
+
+}
+
+#endif
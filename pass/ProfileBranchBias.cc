@@ -1,26 +1,90 @@
+#include "CounterPromotion.h"
+#include "Instrumentation.h"
 #include "llvm/Pass.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Dominators.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/InstIterator.h"
 #include "llvm/IR/Instruction.h"
 #include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
 
 #include <map>
+#include <memory>
+#include <utility>
 #include <vector>
 
 using namespace llvm;
 
+static cl::opt<bool> count_switches(
+    "bb-switches",
+    cl::desc("Also count the cases taken by every switch into the binary "
+             "profile, the program must be linked with lib/lib_prof.cc"),
+    cl::init(false));
+
 namespace {
 
 struct BranchBiasPass : public FunctionPass {
   static char ID;
+  static const uint64_t kTakenKey = 0;
+  static const uint64_t kTotalKey = 1;
   BranchBiasPass() : FunctionPass(ID) { }
 
+  void getAnalysisUsage(AnalysisUsage& AU) const override {
+    if (CounterPromotionEnabled()) {
+      AU.addRequired<DominatorTreeWrapperPass>();
+      AU.addRequired<LoopInfoWrapperPass>();
+    }
+  }
+
+  // Counts the successors taken by every switch of <F> into the binary
+  // profile (see lib/lib_prof.cc) as PROF_SWITCH, with the block of the
+  // switch as site and the successor number as slot: 0 for the default,
+  // i for case i - 1. A successor reached from the switch only is counted
+  // in place; other edges are split to get a block of their own.
+  static void InstrumentSwitches(Function& F) {
+    std::vector<std::pair<SwitchInst*, GlobalVariable*>> switches;
+    unsigned site = 0;
+
+    // All counters are registered before the first split, so the profile
+    // carries the checksum of the original CFG.
+    for (BasicBlock& block : F) {
+      if (SwitchInst* sw = dyn_cast<SwitchInst>(block.getTerminator())) {
+        GlobalVariable* counters = CreateCounterArray(
+            F, "switch." + utostr(site), sw->getNumSuccessors());
+        EmitCounterRegistration(F, PROF_SWITCH, site, counters);
+        switches.push_back(std::make_pair(sw, counters));
+      }
+      ++site;
+    }
+
+    for (const auto& entry : switches) {
+      SwitchInst* sw = entry.first;
+
+      for (unsigned i = 0; i < sw->getNumSuccessors(); ++i) {
+        BasicBlock* counted = SplitCriticalEdge(sw, i);
+        if (counted == nullptr) {
+          counted = sw->getSuccessor(i);
+          if (counted->getSinglePredecessor() != sw->getParent()) {
+            continue;
+          }
+        }
+
+        IRBuilder<> builder(&*counted->getFirstInsertionPt());
+        EmitCounterIncrement(builder, entry.second, i);
+      }
+    }
+  }
+
   bool runOnFunction(Function& F) override {
     Module* mod = F.getParent();
 
-    if (mod == nullptr) {
+    // The constructors registering switch counters are not instrumented.
+    if (mod == nullptr || F.isDeclaration() || IsProfileHelper(F)) {
       return false;
     }
 
@@ -37,6 +101,29 @@ struct BranchBiasPass : public FunctionPass {
           Type::getVoidTy(ctx),
           nullptr));
 
+    // With -promote-counters, branches inside loops are counted in
+    // registers and added to the totals once per loop exit.
+    std::unique_ptr<CounterPromoter> promoter;
+    if (CounterPromotionEnabled()) {
+      Function* addF = cast<Function>(mod->getOrInsertFunction("addBranchInfo",
+            Type::getVoidTy(ctx),
+            IntegerType::getInt64Ty(ctx), /* taken */
+            IntegerType::getInt64Ty(ctx), /* total */
+            nullptr));
+
+      promoter.reset(new CounterPromoter(
+          F, getAnalysis<LoopInfoWrapperPass>().getLoopInfo(),
+          getAnalysis<DominatorTreeWrapperPass>().getDomTree(),
+          [addF](IRBuilder<>& builder, uint64_t key, Value* count) {
+            Value* zero = builder.getInt64(0);
+            if (key == kTakenKey) {
+              builder.CreateCall(addF, {count, zero});
+            } else {
+              builder.CreateCall(addF, {zero, count});
+            }
+          }));
+    }
+
     for (inst_iterator inst_it = inst_begin(F), inst_e = inst_end(F);
        inst_it != inst_e; ++inst_it) {
       BranchInst* br_inst = dyn_cast<BranchInst>(&*inst_it);
@@ -46,7 +133,13 @@ struct BranchBiasPass : public FunctionPass {
         // Update branch bias before conditional.
         if (br_inst->isConditional()) {
           IRBuilder<> builder(br_inst);
-          builder.CreateCall(updateF, {br_inst->getCondition()});
+          if (promoter != nullptr && promoter->Promotes(br_inst->getParent())) {
+            promoter->Add(br_inst, kTakenKey,
+                          builder.CreateZExt(br_inst->getCondition(), builder.getInt64Ty()));
+            promoter->Add(br_inst, kTotalKey, builder.getInt64(1));
+          } else {
+            builder.CreateCall(updateF, {br_inst->getCondition()});
+          }
         }
       } else if (ret_inst != nullptr) {
         // Print statstics before return.
@@ -55,6 +148,16 @@ struct BranchBiasPass : public FunctionPass {
       }
     }
 
+    if (promoter != nullptr) {
+      promoter->Finish();
+    }
+
+    // Splits edges, so it comes after everything that relies on the
+    // dominator tree and loop info.
+    if (count_switches) {
+      InstrumentSwitches(F);
+    }
+
     return false;
   }
 };
@@ -0,0 +1,355 @@
+#ifndef LLVM_PROFILE_DATA_H
+#define LLVM_PROFILE_DATA_H
+
+#include "Instrumentation.h"
+#include "profile_format.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/Function.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace llvm {
+
+// Read-only view of a profile written by lib/lib_prof.cc or the merge tool.
+// The file is mapped, not parsed; lookups binary search the sorted tables.
+class ProfileReader {
+ public:
+  static std::unique_ptr<ProfileReader> Open(StringRef path, std::string& error) {
+    ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(
+        path, -1 /* FileSize */, false /* RequiresNullTerminator */);
+
+    if (!buffer) {
+      error = path.str() + ": " + buffer.getError().message();
+      return nullptr;
+    }
+
+    std::unique_ptr<ProfileReader> reader(new ProfileReader(std::move(*buffer)));
+    if (!reader->Validate()) {
+      error = path.str() + ": not a valid profile";
+      return nullptr;
+    }
+    return reader;
+  }
+
+  ArrayRef<prof_function> functions() const {
+    return ArrayRef<prof_function>(functions_, header_->num_functions);
+  }
+
+  ArrayRef<prof_record> records() const {
+    return ArrayRef<prof_record>(records_, header_->num_records);
+  }
+
+  StringRef name(const prof_function& func) const {
+    return StringRef(names_ + func.name_offset, func.name_size);
+  }
+
+  const prof_function* FindFunction(uint64_t hash) const {
+    ArrayRef<prof_function> funcs = functions();
+    const prof_function* it = std::lower_bound(
+        funcs.begin(), funcs.end(), hash,
+        [](const prof_function& func, uint64_t h) { return func.hash < h; });
+
+    return it != funcs.end() && it->hash == hash ? it : nullptr;
+  }
+
+  // Records of function <hash> of <kind>, sorted by site and slot.
+  ArrayRef<prof_record> FindRecords(uint64_t hash, uint32_t kind) const {
+    ArrayRef<prof_record> recs = records();
+    prof_record lo = {hash, kind, 0, 0, 0, 0, 0};
+    prof_record hi = {hash, kind + 1, 0, 0, 0, 0, 0};
+    const prof_record* begin = std::lower_bound(recs.begin(), recs.end(), lo, prof_record_less);
+    const prof_record* end = std::lower_bound(begin, recs.end(), hi, prof_record_less);
+
+    return ArrayRef<prof_record>(begin, end);
+  }
+
+  // Counters of <F> of <kind> at <site>, indexed by slot. Returns false if
+  // the profile has none, or if they were collected on a different CFG.
+  bool GetCounts(const Function& F, prof_kind kind, uint32_t site,
+                 std::vector<uint64_t>& counts) const {
+    uint64_t hash = ProfileHash(F);
+    const prof_function* func = FindFunction(hash);
+
+    counts.clear();
+    if (func == nullptr || func->cfg_checksum != CFGChecksum(F)) {
+      return false;
+    }
+
+    for (const prof_record& record : FindRecords(hash, kind)) {
+      if (record.site == site) {
+        if (record.slot >= counts.size()) {
+          counts.resize(record.slot + 1, 0);
+        }
+        counts[record.slot] = record.count;
+      }
+    }
+    return !counts.empty();
+  }
+
+  // Values seen by <F> at <site> of the value <kind>, most frequent first,
+  // and how often <site> ran. Returns false if the profile has none, or if
+  // they were collected on a different CFG.
+  bool GetValues(const Function& F, prof_kind kind, uint32_t site,
+                 std::vector<std::pair<uint64_t, uint64_t>>& values,
+                 uint64_t& total) const {
+    uint64_t hash = ProfileHash(F);
+    const prof_function* func = FindFunction(hash);
+
+    values.clear();
+    total = 0;
+    if (func == nullptr || func->cfg_checksum != CFGChecksum(F)) {
+      return false;
+    }
+
+    for (const prof_record& record : FindRecords(hash, kind)) {
+      if (record.site != site) {
+        continue;
+      }
+      if (record.slot == PROF_VALUE_TOTAL) {
+        total = record.count;
+      } else {
+        values.push_back(std::make_pair(record.value, record.count));
+      }
+    }
+    std::stable_sort(values.begin(), values.end(),
+                     [](const std::pair<uint64_t, uint64_t>& a,
+                        const std::pair<uint64_t, uint64_t>& b) {
+                       return a.second > b.second;
+                     });
+    return total != 0;
+  }
+
+ private:
+  explicit ProfileReader(std::unique_ptr<MemoryBuffer> buffer)
+    : buffer_(std::move(buffer)), header_(nullptr), functions_(nullptr),
+      records_(nullptr), names_(nullptr) { }
+
+  bool Validate() {
+    const char* begin = buffer_->getBufferStart();
+    uint64_t size = buffer_->getBufferSize();
+
+    if (size < sizeof(prof_header)) {
+      return false;
+    }
+    header_ = reinterpret_cast<const prof_header*>(begin);
+    if (!prof_header_valid(header_)) {
+      return false;
+    }
+
+    uint64_t functions_size = header_->num_functions * sizeof(prof_function);
+    uint64_t records_size = header_->num_records * sizeof(prof_record);
+    if (header_->num_functions > size || header_->num_records > size ||
+        sizeof(prof_header) + functions_size + records_size + header_->names_size != size) {
+      return false;
+    }
+
+    functions_ = reinterpret_cast<const prof_function*>(begin + sizeof(prof_header));
+    records_ = reinterpret_cast<const prof_record*>(
+        begin + sizeof(prof_header) + functions_size);
+    names_ = begin + sizeof(prof_header) + functions_size + records_size;
+
+    for (const prof_function& func : functions()) {
+      if (func.name_offset + func.name_size > header_->names_size) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  std::unique_ptr<MemoryBuffer> buffer_;
+  const prof_header* header_;
+  const prof_function* functions_;
+  const prof_record* records_;
+  const char* names_;
+};
+
+// Read-only view of a coverage bitmap written by lib/lib_cov.cc.
+class CoverageReader {
+ public:
+  static std::unique_ptr<CoverageReader> Open(StringRef path, std::string& error) {
+    ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(
+        path, -1 /* FileSize */, false /* RequiresNullTerminator */);
+
+    if (!buffer) {
+      error = path.str() + ": " + buffer.getError().message();
+      return nullptr;
+    }
+
+    std::unique_ptr<CoverageReader> reader(new CoverageReader(std::move(*buffer)));
+    if (!reader->Validate()) {
+      error = path.str() + ": not a valid coverage bitmap";
+      return nullptr;
+    }
+    return reader;
+  }
+
+  ArrayRef<cov_function> functions() const {
+    return ArrayRef<cov_function>(functions_, header_->num_functions);
+  }
+
+  StringRef name(const cov_function& func) const {
+    return StringRef(names_ + func.name_offset, func.name_size);
+  }
+
+  // Whether block <block> of <func> ran.
+  bool covered(const cov_function& func, uint64_t block) const {
+    return cov_bit(bitmap_, func.first_bit + block);
+  }
+
+  const cov_function* FindFunction(uint64_t hash) const {
+    ArrayRef<cov_function> funcs = functions();
+    const cov_function* it = std::lower_bound(
+        funcs.begin(), funcs.end(), hash,
+        [](const cov_function& func, uint64_t h) { return func.hash < h; });
+
+    return it != funcs.end() && it->hash == hash ? it : nullptr;
+  }
+
+ private:
+  explicit CoverageReader(std::unique_ptr<MemoryBuffer> buffer)
+    : buffer_(std::move(buffer)), header_(nullptr), functions_(nullptr),
+      bitmap_(nullptr), names_(nullptr) { }
+
+  bool Validate() {
+    const char* begin = buffer_->getBufferStart();
+    uint64_t size = buffer_->getBufferSize();
+
+    if (size < sizeof(cov_header)) {
+      return false;
+    }
+    header_ = reinterpret_cast<const cov_header*>(begin);
+    if (!cov_header_valid(header_)) {
+      return false;
+    }
+
+    uint64_t functions_size = header_->num_functions * sizeof(cov_function);
+    if (header_->num_functions > size ||
+        sizeof(cov_header) + functions_size + header_->bitmap_size + header_->names_size != size) {
+      return false;
+    }
+
+    functions_ = reinterpret_cast<const cov_function*>(begin + sizeof(cov_header));
+    bitmap_ = reinterpret_cast<const uint8_t*>(begin + sizeof(cov_header) + functions_size);
+    names_ = begin + sizeof(cov_header) + functions_size + header_->bitmap_size;
+
+    for (const cov_function& func : functions()) {
+      if (func.name_offset + func.name_size > header_->names_size ||
+          func.first_bit + func.num_blocks > header_->bitmap_size * 8) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  std::unique_ptr<MemoryBuffer> buffer_;
+  const cov_header* header_;
+  const cov_function* functions_;
+  const uint8_t* bitmap_;
+  const char* names_;
+};
+
+// A function of a profile being assembled in memory.
+struct ProfileFunction {
+  uint64_t cfg_checksum;
+  std::string name;
+};
+
+// Writes a profile of <functions>, keyed by hash, and <records>, which must
+// be sorted with prof_record_less.
+inline bool WriteProfile(StringRef path, const std::map<uint64_t, ProfileFunction>& functions,
+                         const std::vector<prof_record>& records, std::string& error) {
+  std::vector<prof_function> entries;
+  std::string names;
+
+  for (const auto& func : functions) {
+    prof_function entry = {func.first, func.second.cfg_checksum, names.size(),
+                           func.second.name.size()};
+    entries.push_back(entry);
+    names += func.second.name;
+  }
+
+  prof_header header;
+  memcpy(header.magic, PROF_MAGIC, 4);
+  header.version = PROF_VERSION;
+  header.num_functions = entries.size();
+  header.num_records = records.size();
+  header.names_size = names.size();
+
+  std::error_code ec;
+  raw_fd_ostream os(path, ec, sys::fs::F_None);
+  if (ec) {
+    error = path.str() + ": " + ec.message();
+    return false;
+  }
+  os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  os.write(reinterpret_cast<const char*>(entries.data()),
+           entries.size() * sizeof(prof_function));
+  os.write(reinterpret_cast<const char*>(records.data()),
+           records.size() * sizeof(prof_record));
+  os << names;
+  return true;
+}
+
+// A function of a coverage bitmap being assembled in memory.
+struct CoverageFunction {
+  uint64_t cfg_checksum;
+  std::string name;
+  std::vector<bool> covered;
+};
+
+// Writes a coverage bitmap of <functions>, keyed by hash.
+inline bool WriteCoverage(StringRef path, const std::map<uint64_t, CoverageFunction>& functions,
+                          std::string& error) {
+  std::vector<cov_function> entries;
+  std::vector<uint8_t> bitmap;
+  std::string names;
+  uint64_t bit = 0;
+
+  for (const auto& func : functions) {
+    uint64_t num_blocks = func.second.covered.size();
+    cov_function entry = {func.first, func.second.cfg_checksum, names.size(),
+                          func.second.name.size(), bit, num_blocks};
+    entries.push_back(entry);
+    names += func.second.name;
+
+    bitmap.resize((bit + num_blocks + 7) / 8, 0);
+    for (uint64_t i = 0; i < num_blocks; ++i, ++bit) {
+      if (func.second.covered[i]) {
+        bitmap[bit / 8] |= 1 << (bit % 8);
+      }
+    }
+  }
+
+  cov_header header;
+  memcpy(header.magic, COV_MAGIC, 4);
+  header.version = COV_VERSION;
+  header.num_functions = entries.size();
+  header.bitmap_size = bitmap.size();
+  header.names_size = names.size();
+
+  std::error_code ec;
+  raw_fd_ostream os(path, ec, sys::fs::F_None);
+  if (ec) {
+    error = path.str() + ": " + ec.message();
+    return false;
+  }
+  os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  os.write(reinterpret_cast<const char*>(entries.data()),
+           entries.size() * sizeof(cov_function));
+  os.write(reinterpret_cast<const char*>(bitmap.data()), bitmap.size());
+  os << names;
+  return true;
+}
+
+}
+
+#endif
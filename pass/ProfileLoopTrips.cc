@@ -0,0 +1,131 @@
+#include "Instrumentation.h"
+#include "llvm/Pass.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Transforms/Utils/PromoteMemToReg.h"
+
+#include <vector>
+
+using namespace llvm;
+
+namespace {
+
+// Records how many times the header of each loop runs per entry into the
+// loop, as a log2 histogram in the binary profile (see lib/lib_prof.cc).
+// The trip count lives in a register that is zeroed in the preheader and
+// bumped in the header; every exit adds one to its bucket.
+struct LoopTripPass : public FunctionPass {
+  static char ID;
+  LoopTripPass() : FunctionPass(ID) { }
+
+  void getAnalysisUsage(AnalysisUsage& AU) const override {
+    AU.addRequired<DominatorTreeWrapperPass>();
+    AU.addRequired<LoopInfoWrapperPass>();
+  }
+
+  static void CollectLoops(Loop* loop, std::vector<Loop*>& loops) {
+    loops.push_back(loop);
+    for (Loop* sub : loop->getSubLoops()) {
+      CollectLoops(sub, loops);
+    }
+  }
+
+  // Loops are instrumented without changing the CFG, so they need a
+  // preheader and exits that are reached from the loop only.
+  static bool IsInstrumentable(Loop* loop, const SmallVectorImpl<BasicBlock*>& exits) {
+    if (loop->getLoopPreheader() == nullptr || !loop->hasDedicatedExits()) {
+      return false;
+    }
+    for (BasicBlock* exit : exits) {
+      if (exit->getFirstInsertionPt() == exit->end()) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool runOnFunction(Function& F) override {
+    if (F.isDeclaration() || IsProfileHelper(F)) {
+      return false;
+    }
+
+    LoopInfo& LI = getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
+    DominatorTree& DT = getAnalysis<DominatorTreeWrapperPass>().getDomTree();
+
+    DenseMap<BasicBlock*, unsigned> block_index;
+    unsigned n = 0;
+    for (BasicBlock& block : F) {
+      block_index[&block] = n++;
+    }
+
+    std::vector<Loop*> loops;
+    for (Loop* loop : LI) {
+      CollectLoops(loop, loops);
+    }
+
+    Module* mod = F.getParent();
+    Function* ctlzF = Intrinsic::getDeclaration(
+        mod, Intrinsic::ctlz, {Type::getInt64Ty(F.getContext())});
+    std::vector<AllocaInst*> trips;
+
+    for (Loop* loop : loops) {
+      SmallVector<BasicBlock*, 4> exits;
+      loop->getUniqueExitBlocks(exits);
+      if (!IsInstrumentable(loop, exits)) {
+        continue;
+      }
+
+      // Loops are named by their header, matching the block profile.
+      unsigned site = block_index[loop->getHeader()];
+      GlobalVariable* histogram = CreateCounterArray(
+          F, "trips." + utostr(site), PROF_TRIP_BUCKETS);
+
+      IRBuilder<> builder(&*F.getEntryBlock().getFirstInsertionPt());
+      AllocaInst* count = builder.CreateAlloca(builder.getInt64Ty(), nullptr, "prof.trips");
+      trips.push_back(count);
+
+      builder.SetInsertPoint(loop->getLoopPreheader()->getTerminator());
+      builder.CreateStore(builder.getInt64(0), count);
+
+      builder.SetInsertPoint(&*loop->getHeader()->getFirstInsertionPt());
+      builder.CreateStore(builder.CreateAdd(builder.CreateLoad(count), builder.getInt64(1)),
+                          count);
+
+      // The header ran at least once, so the count is never zero here and
+      // its bucket is 63 - ctlz(count).
+      for (BasicBlock* exit : exits) {
+        builder.SetInsertPoint(&*exit->getFirstInsertionPt());
+        Value* zeros = builder.CreateCall(ctlzF, {builder.CreateLoad(count),
+                                                   builder.getTrue() /* zero undef */});
+        Value* bucket = builder.CreateSub(builder.getInt64(PROF_TRIP_BUCKETS - 1), zeros);
+        Value* slot = builder.CreateInBoundsGEP(histogram, {builder.getInt64(0), bucket});
+        builder.CreateStore(builder.CreateAdd(builder.CreateLoad(slot), builder.getInt64(1)),
+                            slot);
+      }
+
+      EmitCounterRegistration(F, PROF_LOOP_TRIPS, site, histogram);
+    }
+
+    if (trips.empty()) {
+      return false;
+    }
+
+    PromoteMemToReg(trips, DT);
+    return true;
+  }
+};
+
+}
+
+char LoopTripPass::ID = 0;
+static RegisterPass<LoopTripPass> X(
+    "ltc", "Profile loop trip counts",
+    false /* Only looks at CFG */,
+    false /* Analysis Pass */);
@@ -0,0 +1,202 @@
+#include "ProfileUse.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/Mutex.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <memory>
+#include <string>
+
+using namespace llvm;
+
+static cl::opt<std::string> profile_use(
+    "profile-use",
+    cl::desc("Binary profile (see lib/lib_prof.cc) for the profile guided "
+             "passes; functions whose CFG changed since, other than by "
+             "these passes, are left alone"),
+    cl::value_desc("file"), cl::init(""));
+
+const ProfileReader* llvm::UsedProfile() {
+  static sys::Mutex lock;
+  static bool loaded = false;
+  static std::unique_ptr<ProfileReader> reader;
+
+  // Passes may run on several threads in llvm-pass-run.
+  sys::ScopedLock guard(lock);
+  if (!loaded && !profile_use.empty()) {
+    std::string error;
+    reader = ProfileReader::Open(profile_use, error);
+    if (reader == nullptr) {
+      errs() << "warning: " << error << ", not used\n";
+    }
+  }
+  loaded = true;
+  return reader.get();
+}
+
+// Metadata kind of the attached counts of <kind>.
+static unsigned CountKind(LLVMContext& ctx, prof_kind kind) {
+  switch (kind) {
+  case PROF_BLOCK:
+    return ctx.getMDKindID("llvm-pass.block-count");
+  case PROF_SAMPLES:
+    return ctx.getMDKindID("llvm-pass.block-samples");
+  case PROF_CALL:
+    return ctx.getMDKindID("llvm-pass.call-count");
+  case PROF_SWITCH:
+    return ctx.getMDKindID("llvm-pass.switch-counts");
+  default:
+    llvm_unreachable("counts of this kind are not attached");
+  }
+}
+
+static bool GetAttached(const Instruction* inst, prof_kind kind,
+                        std::vector<uint64_t>& counts) {
+  MDNode* node = inst->getMetadata(CountKind(inst->getContext(), kind));
+
+  counts.clear();
+  if (node == nullptr) {
+    return false;
+  }
+  for (const MDOperand& op : node->operands()) {
+    counts.push_back(mdconst::extract<ConstantInt>(op)->getZExtValue());
+  }
+  return true;
+}
+
+static void SetAttached(Instruction* inst, prof_kind kind, ArrayRef<uint64_t> counts) {
+  LLVMContext& ctx = inst->getContext();
+  std::vector<Metadata*> ops;
+
+  for (uint64_t count : counts) {
+    ops.push_back(ConstantAsMetadata::get(ConstantInt::get(Type::getInt64Ty(ctx), count)));
+  }
+  inst->setMetadata(CountKind(ctx, kind), MDNode::get(ctx, ops));
+}
+
+// Whether some instruction of <F> carries counts of <kind>.
+static bool HasAttached(Function& F, prof_kind kind) {
+  unsigned md_kind = CountKind(F.getContext(), kind);
+
+  for (inst_iterator inst_it = inst_begin(F), inst_e = inst_end(F);
+       inst_it != inst_e; ++inst_it) {
+    if (inst_it->getMetadata(md_kind) != nullptr) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool llvm::AttachProfileCounts(Function& F) {
+  const ProfileReader* profile = UsedProfile();
+  std::vector<uint64_t> counts;
+  bool attached = false;
+
+  if (profile == nullptr || F.isDeclaration()) {
+    return false;
+  }
+
+  // Blocks are numbered in layout order, a switch by its block.
+  for (prof_kind kind : {PROF_BLOCK, PROF_SAMPLES}) {
+    if (HasAttached(F, kind) || !profile->GetCounts(F, kind, 0, counts)) {
+      continue;
+    }
+    size_t index = 0;
+    for (BasicBlock& block : F) {
+      SetBlockCount(&block, kind, index < counts.size() ? counts[index] : 0);
+      ++index;
+    }
+    attached = true;
+  }
+
+  if (!HasAttached(F, PROF_SWITCH)) {
+    uint32_t site = 0;
+    for (BasicBlock& block : F) {
+      SwitchInst* sw = dyn_cast<SwitchInst>(block.getTerminator());
+      if (sw != nullptr && profile->GetCounts(F, PROF_SWITCH, site, counts) &&
+          counts.size() == sw->getNumSuccessors()) {
+        SetSwitchCounts(sw, counts);
+        attached = true;
+      }
+      ++site;
+    }
+  }
+
+  // Calls are numbered in instruction order, as the csc pass numbered them.
+  if (!HasAttached(F, PROF_CALL) && profile->GetCounts(F, PROF_CALL, 0, counts)) {
+    std::vector<Instruction*> calls;
+    for (inst_iterator inst_it = inst_begin(F), inst_e = inst_end(F);
+         inst_it != inst_e; ++inst_it) {
+      if (IsDirectCall(*inst_it)) {
+        calls.push_back(&*inst_it);
+      }
+    }
+    if (calls.size() == counts.size()) {
+      for (size_t i = 0; i < calls.size(); ++i) {
+        SetAttached(calls[i], PROF_CALL, counts[i]);
+      }
+      attached = true;
+    }
+  }
+  return attached;
+}
+
+bool llvm::GetBlockCounts(Function& F, prof_kind kind, DenseMap<BasicBlock*, uint64_t>& counts) {
+  uint64_t count;
+
+  counts.clear();
+  for (BasicBlock& block : F) {
+    if (GetBlockCount(&block, kind, count)) {
+      counts[&block] = count;
+    }
+  }
+  if (!counts.empty()) {
+    return true;
+  }
+
+  const ProfileReader* profile = UsedProfile();
+  std::vector<uint64_t> profiled;
+  if (profile == nullptr || !profile->GetCounts(F, kind, 0, profiled)) {
+    return false;
+  }
+  size_t index = 0;
+  for (BasicBlock& block : F) {
+    counts[&block] = index < profiled.size() ? profiled[index] : 0;
+    ++index;
+  }
+  return true;
+}
+
+bool llvm::GetBlockCount(const BasicBlock* block, prof_kind kind, uint64_t& count) {
+  std::vector<uint64_t> counts;
+  if (!GetAttached(block->getTerminator(), kind, counts) || counts.size() != 1) {
+    return false;
+  }
+  count = counts[0];
+  return true;
+}
+
+void llvm::SetBlockCount(BasicBlock* block, prof_kind kind, uint64_t count) {
+  SetAttached(block->getTerminator(), kind, count);
+}
+
+bool llvm::GetCallCount(const Instruction* call, uint64_t& count) {
+  std::vector<uint64_t> counts;
+  if (!GetAttached(call, PROF_CALL, counts) || counts.size() != 1) {
+    return false;
+  }
+  count = counts[0];
+  return true;
+}
+
+bool llvm::GetSwitchCounts(const SwitchInst* sw, std::vector<uint64_t>& counts) {
+  return GetAttached(sw, PROF_SWITCH, counts) && counts.size() == sw->getNumSuccessors();
+}
+
+void llvm::SetSwitchCounts(SwitchInst* sw, ArrayRef<uint64_t> counts) {
+  SetAttached(sw, PROF_SWITCH, counts);
+}
@@ -0,0 +1,49 @@
+#ifndef LLVM_PROFILE_USE_H
+#define LLVM_PROFILE_USE_H
+
+#include "ProfileData.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+
+#include <vector>
+
+namespace llvm {
+
+// The profile given by -profile-use, shared by the passes that optimize
+// with it. Loaded on first use; returns null if no profile was given, or,
+// after reporting why once, if it cannot be read.
+const ProfileReader* UsedProfile();
+
+// The profile only fits the CFG it was collected on, so the counts travel
+// with the code as metadata: block counts and samples on the terminators,
+// call counts on the direct calls, switch counts on the switches. Profile
+// guided passes attach them before they change a function, and the passes
+// after them read them back from there.
+//
+// Attaches the counts of the profile to <F>, each kind unless <F> carries
+// counts of it already. Returns true if it attached any.
+bool AttachProfileCounts(Function& F);
+
+// Counts of <kind> (PROF_BLOCK or PROF_SAMPLES) of the blocks of <F>, from
+// their metadata, or from the profile if <F> carries none. Blocks without a
+// count, such as those added since, are left out. Returns false if there
+// are none.
+bool GetBlockCounts(Function& F, prof_kind kind, DenseMap<BasicBlock*, uint64_t>& counts);
+
+// Count of <kind> attached to <block>, for passes that add blocks.
+bool GetBlockCount(const BasicBlock* block, prof_kind kind, uint64_t& count);
+void SetBlockCount(BasicBlock* block, prof_kind kind, uint64_t count);
+
+// Executions of the direct call <call> attached to it.
+bool GetCallCount(const Instruction* call, uint64_t& count);
+
+// Executions of each successor of <sw> attached to it, default first.
+bool GetSwitchCounts(const SwitchInst* sw, std::vector<uint64_t>& counts);
+void SetSwitchCounts(SwitchInst* sw, ArrayRef<uint64_t> counts);
+
+}
+
+#endif
@@ -0,0 +1,87 @@
+#include "Instrumentation.h"
+#include "llvm/Pass.h"
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instruction.h"
+#include "llvm/IR/Module.h"
+
+#include <vector>
+
+using namespace llvm;
+
+namespace {
+
+// Records the most frequent divisors of divisions and remainders, and the
+// most frequent targets of indirect calls, into the binary profile (see
+// lib/lib_prof.cc). Each site keeps a small top-N table, so the hot path
+// is one call scanning a few entries.
+struct ValueProfilePass : public FunctionPass {
+  static char ID;
+  ValueProfilePass() : FunctionPass(ID) { }
+
+  bool runOnFunction(Function& F) override {
+    if (F.isDeclaration() || IsProfileHelper(F)) {
+      return false;
+    }
+
+    bool changed = false;
+
+    // Indirect calls can only be attributed to functions whose address
+    // the runtime knows.
+    if (F.hasAddressTaken()) {
+      EmitFunctionAddressRegistration(F);
+      changed = true;
+    }
+
+    std::vector<Instruction*> divisions, calls;
+    for (inst_iterator inst_it = inst_begin(F), inst_e = inst_end(F);
+         inst_it != inst_e; ++inst_it) {
+      if (IsProfiledDivision(*inst_it)) {
+        divisions.push_back(&*inst_it);
+      } else if (IsIndirectCall(*inst_it)) {
+        calls.push_back(&*inst_it);
+      }
+    }
+
+    if (!divisions.empty()) {
+      GlobalVariable* sites = CreateValueSiteArray(F, "div", divisions.size());
+
+      for (size_t i = 0; i < divisions.size(); ++i) {
+        IRBuilder<> builder(divisions[i]);
+        Value* divisor = divisions[i]->getOperand(1);
+
+        // Signed divisors keep their sign in the profile.
+        if (divisions[i]->getOpcode() == Instruction::SDiv ||
+            divisions[i]->getOpcode() == Instruction::SRem) {
+          divisor = builder.CreateSExt(divisor, builder.getInt64Ty());
+        }
+        EmitValueProfile(builder, sites, i, divisor);
+      }
+      EmitValueSiteRegistration(F, PROF_DIVISOR, sites);
+      changed = true;
+    }
+
+    if (!calls.empty()) {
+      GlobalVariable* sites = CreateValueSiteArray(F, "icall", calls.size());
+
+      for (size_t i = 0; i < calls.size(); ++i) {
+        IRBuilder<> builder(calls[i]);
+        EmitValueProfile(builder, sites, i, CallSite(calls[i]).getCalledValue());
+      }
+      EmitValueSiteRegistration(F, PROF_INDIRECT_CALL, sites);
+      changed = true;
+    }
+
+    return changed;
+  }
+};
+
+}
+
+char ValueProfilePass::ID = 0;
+static RegisterPass<ValueProfilePass> X(
+    "vp", "Profile divisors and indirect call targets",
+    false /* Only looks at CFG */,
+    false /* Analysis Pass */);
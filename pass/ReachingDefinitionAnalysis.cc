@@ -1,67 +1,19 @@
-#include "DataflowAnalysis.h"
+#include "ReachingDefinitionAnalysis.h"
 #include "llvm/Pass.h"
 #include "llvm/IR/Function.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
 
 #include <set>
 
 using namespace llvm;
 
-class ReachingInfo : public AnalysisInfo {
- public:
-  void insert(int var) {
-    reachable_.insert(var);
-  }
-
-  size_t size() const {
-    return reachable_.size();
-  }
-
-  virtual void Print() {
-    for (std::set<int>::iterator it = reachable_.begin(); it != reachable_.end(); ++it) {
-      errs() << *it << '|';
-    }
-    errs() << '\n';
-  }
-
-  static ReachingInfo Bottom() {
-    return ReachingInfo();
-  }
-
-  static bool Equals(const ReachingInfo* info1, const ReachingInfo* info2) {
-    return info1->reachable_ == info2->reachable_;
-  }
-
-  static std::unique_ptr<ReachingInfo> Join(const ReachingInfo* info1,
-      const ReachingInfo* info2) {
-    std::unique_ptr<ReachingInfo> ret(new ReachingInfo(*info1));
-
-    for (int var : info2->reachable_) {
-      ret->insert(var);
-    }
-    return ret;
-  }
-
- private:
-  std::set<int> reachable_;
-};
-
-class ReachingDefinitionAnalysis
-   : public DataFlowAnalysis<ReachingInfo, true /* Direction */> {
-
- public:
-  ReachingDefinitionAnalysis()
-    : DataFlowAnalysis<ReachingInfo, true>(
-        ReachingInfo::Bottom(), ReachingInfo::Bottom()) { }
-
- private:
-  void FlowFunction(
-      Instruction* I,
-      int inst_index,
-      const ReachingInfo& in,
-      const std::vector<Edge>& outs,
-      std::vector<ReachingInfo>& infos) const override;
-};
+static cl::opt<bool> track_memory(
+    "reaching-memory",
+    cl::desc("Also track the stores into stack slots, resolving pointers "
+             "with the pointer analysis"),
+    cl::init(false));
 
 void ReachingDefinitionAnalysis::FlowFunction(
     Instruction* I,
@@ -135,16 +87,80 @@ void ReachingDefinitionAnalysis::FlowFunction(
   }
 }
 
+MemoryReachingDefinitionAnalysis::MemoryReachingDefinitionAnalysis(
+    Function* F, const StackSlots& slots)
+  : slots_(slots) {
+  for (inst_iterator inst_it = inst_begin(F), inst_e = inst_end(F);
+       inst_it != inst_e; ++inst_it) {
+    Instruction* I = &*inst_it;
+    if (!isa<StoreInst>(I)) {
+      continue;
+    }
+
+    const std::set<int>& accessed = slots.Accessed(I);
+    for (int slot : accessed) {
+      stores_into_[slot].push_back(I);
+    }
+    if (accessed.size() == 1) {
+      only_into_[*accessed.begin()].push_back(I);
+    }
+  }
+}
+
+const std::vector<Instruction*>& MemoryReachingDefinitionAnalysis::StoresInto(int slot) const {
+  static const std::vector<Instruction*> none;
+  std::map<int, std::vector<Instruction*>>::const_iterator it = stores_into_.find(slot);
+  return it == stores_into_.end() ? none : it->second;
+}
+
+void MemoryReachingDefinitionAnalysis::FlowFunction(
+    Instruction* I,
+    int inst_index,
+    const ReachingInfo& in,
+    const std::vector<Edge>& outs,
+    std::vector<ReachingInfo>& infos) const {
+  ReachingDefinitionAnalysis::FlowFunction(I, inst_index, in, outs, infos);
+  if (!isa<StoreInst>(I) || slots_.Accessed(I).empty()) {
+    return;
+  }
+
+  int whole = slots_.WholeSlot(I);
+  std::map<int, std::vector<Instruction*>>::const_iterator killed = only_into_.find(whole);
+  for (ReachingInfo& info : infos) {
+    if (whole != 0 && killed != only_into_.end()) {
+      for (Instruction* store : killed->second) {
+        info.erase(IndexOf(store));
+      }
+    }
+    info.insert(inst_index);
+  }
+}
+
 namespace {
 
 struct ReachingDefinitionAnalysisPass : public FunctionPass {
   static char ID;
   ReachingDefinitionAnalysisPass() : FunctionPass(ID) { }
 
+  void getAnalysisUsage(AnalysisUsage& AU) const override {
+    AU.addRequired<TargetLibraryInfoWrapperPass>();
+  }
+
   bool runOnFunction(Function& F) override {
+    if (track_memory) {
+      PointerAnalysis pointers(&getAnalysis<TargetLibraryInfoWrapperPass>().getTLI());
+      pointers.Solve(&F);
+
+      StackSlots slots(&F, pointers);
+      MemoryReachingDefinitionAnalysis analyzer(&F, slots);
+      analyzer.RunWorklistAlgorithm(&F);
+      analyzer.Print();
+      return false;
+    }
+
     ReachingDefinitionAnalysis analyzer;
 
-    analyzer.RunWorklistAlgorithm(&F);
+    analyzer.RunCachedWorklistAlgorithm(&F, "reaching", 1 /* version */);
     analyzer.Print();
 
     return false;
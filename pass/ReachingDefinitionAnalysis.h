@@ -0,0 +1,149 @@
+#ifndef LLVM_REACHING_DEFINITION_ANALYSIS_H
+#define LLVM_REACHING_DEFINITION_ANALYSIS_H
+
+#include "DataflowAnalysis.h"
+#include "PointerAnalysis.h"
+#include "llvm/IR/Function.h"
+
+#include <map>
+#include <set>
+#include <vector>
+
+namespace llvm {
+
+class ReachingInfo : public AnalysisInfo {
+ public:
+  void insert(int var) {
+    reachable_.insert(var);
+  }
+
+  void erase(int var) {
+    reachable_.erase(var);
+  }
+
+  bool contains(int var) const {
+    return reachable_.count(var) != 0;
+  }
+
+  size_t size() const {
+    return reachable_.size();
+  }
+
+  virtual void Print() {
+    for (std::set<int>::iterator it = reachable_.begin(); it != reachable_.end(); ++it) {
+      ResultStream() << *it << '|';
+    }
+    ResultStream() << '\n';
+  }
+
+  // An array of the indices.
+  void PrintJSON(raw_ostream& os) const {
+    for (std::set<int>::const_iterator it = reachable_.begin(); it != reachable_.end(); ++it) {
+      os << (it == reachable_.begin() ? "[" : ",") << *it;
+    }
+    os << (reachable_.empty() ? "[]" : "]");
+  }
+
+  // Sorted indices, delta encoded.
+  void Serialize(std::string& out) const {
+    int prev = 0;
+
+    WriteVarint(out, reachable_.size());
+    for (int var : reachable_) {
+      WriteVarint(out, var - prev);
+      prev = var;
+    }
+  }
+
+  bool Deserialize(const char*& p, const char* end) {
+    uint64_t n, delta;
+    int var = 0;
+
+    if (!ReadVarint(p, end, n)) {
+      return false;
+    }
+    for (uint64_t i = 0; i < n; ++i) {
+      if (!ReadVarint(p, end, delta)) {
+        return false;
+      }
+      var += delta;
+      insert(var);
+    }
+    return true;
+  }
+
+  static ReachingInfo Bottom() {
+    return ReachingInfo();
+  }
+
+  static ReachingInfo Singleton(int var) {
+    ReachingInfo info;
+    info.insert(var);
+    return info;
+  }
+
+  static bool Equals(const ReachingInfo* info1, const ReachingInfo* info2) {
+    return info1->reachable_ == info2->reachable_;
+  }
+
+  static std::unique_ptr<ReachingInfo> Join(const ReachingInfo* info1,
+      const ReachingInfo* info2) {
+    std::unique_ptr<ReachingInfo> ret(new ReachingInfo(*info1));
+
+    for (int var : info2->reachable_) {
+      ret->insert(var);
+    }
+    return ret;
+  }
+
+ private:
+  std::set<int> reachable_;
+};
+
+class ReachingDefinitionAnalysis
+   : public DataFlowAnalysis<ReachingInfo, true /* Direction */> {
+
+ public:
+  ReachingDefinitionAnalysis()
+    : DataFlowAnalysis<ReachingInfo, true>(
+        ReachingInfo::Bottom(), ReachingInfo::Bottom()) { }
+
+ protected:
+  void FlowFunction(
+      Instruction* I,
+      int inst_index,
+      const ReachingInfo& in,
+      const std::vector<Edge>& outs,
+      std::vector<ReachingInfo>& infos) const override;
+};
+
+// Reaching definitions of stack slots on top of those of SSA values: every
+// store into a slot <slots> tracks is a definition, named by its index. A
+// store that writes all of a slot kills the stores that could only have
+// written that slot; stores that may have written another slot as well
+// still reach past it.
+class MemoryReachingDefinitionAnalysis : public ReachingDefinitionAnalysis {
+ public:
+  // <slots> must describe <F>.
+  MemoryReachingDefinitionAnalysis(Function* F, const StackSlots& slots);
+
+  // The stores into the tracked slot <slot>.
+  const std::vector<Instruction*>& StoresInto(int slot) const;
+
+ protected:
+  void FlowFunction(
+      Instruction* I,
+      int inst_index,
+      const ReachingInfo& in,
+      const std::vector<Edge>& outs,
+      std::vector<ReachingInfo>& infos) const override;
+
+ private:
+  const StackSlots& slots_;
+  std::map<int, std::vector<Instruction*>> stores_into_;
+  std::map<int, std::vector<Instruction*>> only_into_;
+};
+
+}
+
+#endif
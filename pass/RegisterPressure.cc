@@ -0,0 +1,215 @@
+#include "LivenessAnalysis.h"
+#include "ProfileUse.h"
+#include "ResultStream.h"
+#include "llvm/Pass.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/CommandLine.h"
+
+#include <algorithm>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+static cl::opt<unsigned> num_registers(
+    "pressure-registers",
+    cl::desc("Registers values can live in before they spill"),
+    cl::init(16));
+
+static cl::opt<unsigned> top_regions(
+    "pressure-top",
+    cl::desc("Regions reported per function, 0 for all"),
+    cl::init(10));
+
+namespace {
+
+// A block, or a loop named by its header.
+struct Region {
+  bool loop;
+  BasicBlock* block;
+  unsigned index;
+  unsigned depth;
+  unsigned max_live;
+  unsigned live_in;
+  uint64_t count;
+  uint64_t score;
+};
+
+// Reports where register pressure is highest, from the liveness of
+// SSALivenessAnalysis: the most values live at once at any point of
+// each block and loop, and how many are live into it. Values that do not
+// take a register, the addresses of static allocas among them, are not
+// counted. A region's score is what its pressure exceeds
+// -pressure-registers by, times how often it runs by the block counts of
+// -profile-use, or once without a profile.
+//
+// Prints one tab separated row per region, the highest scores of each
+// function first, under a header line; with -result-format=jsonl one object
+// per region instead. Only the functions -result-functions selects are
+// reported.
+struct RegisterPressurePass : public FunctionPass {
+  static char ID;
+  RegisterPressurePass() : FunctionPass(ID), printed_header_(false) { }
+
+  void getAnalysisUsage(AnalysisUsage& AU) const override {
+    AU.addRequired<LoopInfoWrapperPass>();
+    AU.setPreservesAll();
+  }
+
+  static bool NeedsRegister(Instruction* I) {
+    AllocaInst* alloca = dyn_cast<AllocaInst>(I);
+    return !I->getType()->isVoidTy() && (alloca == nullptr || !alloca->isStaticAlloca());
+  }
+
+  // Values needing a register in <values>.
+  static unsigned CountRegisters(const SSALivenessAnalysis& liveness,
+                                 const std::vector<int>& values) {
+    unsigned n = 0;
+    for (int value : values) {
+      n += NeedsRegister(liveness.InstructionAt(value));
+    }
+    return n;
+  }
+
+  // Most values needing a register live at once in <block>, walking back
+  // from its end over every point after its phis.
+  static unsigned MaxLive(const SSALivenessAnalysis& liveness, BasicBlock* block) {
+    const std::vector<int>& out = liveness.LiveOut(block);
+    std::set<int> live(out.begin(), out.end());
+    unsigned cur = CountRegisters(liveness, out);
+    unsigned max_live = cur;
+
+    for (Instruction* I = block->getTerminator(); I != nullptr && !isa<PHINode>(I);
+         I = I->getPrevNode()) {
+      if (live.erase(liveness.IndexOf(I)) && NeedsRegister(I)) {
+        --cur;
+      }
+      for (Value* operand : I->operands()) {
+        Instruction* inst = dyn_cast<Instruction>(operand);
+        int index = inst == nullptr ? 0 : liveness.IndexOf(inst);
+        if (index != 0 && live.insert(index).second && NeedsRegister(inst)) {
+          ++cur;
+        }
+      }
+      max_live = std::max(max_live, cur);
+    }
+    return max_live;
+  }
+
+  static void CollectLoops(Loop* loop, std::vector<Loop*>& loops) {
+    loops.push_back(loop);
+    for (Loop* sub : loop->getSubLoops()) {
+      CollectLoops(sub, loops);
+    }
+  }
+
+  uint64_t Score(unsigned max_live, uint64_t count) const {
+    return max_live > num_registers ? (max_live - num_registers) * count : 0;
+  }
+
+  bool runOnFunction(Function& F) override {
+    if (F.isDeclaration() || !WantsResultsOf(F.getName())) {
+      return false;
+    }
+
+    LoopInfo& LI = getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
+    SSALivenessAnalysis liveness;
+    liveness.Run(&F);
+
+    DenseMap<BasicBlock*, uint64_t> counts;
+    bool profiled = UsedProfile() != nullptr &&
+                    (GetBlockCounts(F, PROF_BLOCK, counts) ||
+                     GetBlockCounts(F, PROF_SAMPLES, counts));
+
+    std::vector<Region> regions;
+    DenseMap<BasicBlock*, size_t> region_of;
+    for (BasicBlock& block : F) {
+      unsigned index = regions.size();
+      uint64_t count = !profiled ? 1 : counts.lookup(&block);
+      unsigned max_live = MaxLive(liveness, &block);
+
+      region_of[&block] = index;
+      regions.push_back(Region{
+          false, &block, index, LI.getLoopDepth(&block), max_live,
+          CountRegisters(liveness, liveness.LiveIn(&block)), count,
+          Score(max_live, count)});
+    }
+
+    std::vector<Loop*> loops;
+    for (Loop* loop : LI) {
+      CollectLoops(loop, loops);
+    }
+    for (Loop* loop : loops) {
+      Region region = regions[region_of[loop->getHeader()]];
+      region.loop = true;
+      for (BasicBlock* block : loop->blocks()) {
+        region.max_live = std::max(region.max_live, regions[region_of[block]].max_live);
+      }
+      region.score = Score(region.max_live, region.count);
+      regions.push_back(region);
+    }
+
+    std::stable_sort(regions.begin(), regions.end(),
+                     [](const Region& a, const Region& b) {
+                       return a.score != b.score ? a.score > b.score
+                                                 : a.max_live > b.max_live;
+                     });
+    if (top_regions != 0 && regions.size() > top_regions) {
+      regions.resize(top_regions);
+    }
+
+    raw_ostream& os = ResultStream();
+    bool json = GetResultFormat() == RESULT_JSONL;
+    if (!json && !printed_header_) {
+      os << "function\tregion\tblock\tdepth\tmax_live\tlive_in\tcount\tscore\n";
+      printed_header_ = true;
+    }
+    for (const Region& region : regions) {
+      std::string block = region.block->hasName()
+                              ? region.block->getName().str()
+                              : "#" + std::to_string(region.index);
+      if (json) {
+        os << "{\"function\":";
+        WriteJSONString(os, F.getName());
+        os << ",\"region\":\"" << (region.loop ? "loop" : "block") << "\",\"block\":";
+        WriteJSONString(os, block);
+        os << ",\"depth\":" << region.depth << ",\"max_live\":" << region.max_live
+           << ",\"live_in\":" << region.live_in << ",\"count\":";
+        if (profiled) {
+          os << region.count;
+        } else {
+          os << "null";
+        }
+        os << ",\"score\":" << region.score << "}\n";
+        continue;
+      }
+
+      os << F.getName() << '\t' << (region.loop ? "loop" : "block")
+         << '\t' << block << '\t' << region.depth
+         << '\t' << region.max_live << '\t' << region.live_in << '\t';
+      if (profiled) {
+        os << region.count;
+      } else {
+        os << '-';
+      }
+      os << '\t' << region.score << '\n';
+    }
+    FlushResultStream();
+    return false;
+  }
+
+  bool printed_header_;
+};
+
+}
+
+char RegisterPressurePass::ID = 0;
+static RegisterPass<RegisterPressurePass> X(
+    "pressure", "Report register pressure hotspots",
+    false /* Only looks at CFG */,
+    false /* Analysis Pass */);
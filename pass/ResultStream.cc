@@ -0,0 +1,115 @@
+#include "ResultStream.h"
+#include "AnalysisCache.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Compiler.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+
+using namespace llvm;
+
+static cl::opt<ResultFormat> result_format(
+    "result-format",
+    cl::desc("Format analysis results are written in"),
+    cl::values(clEnumValN(RESULT_TEXT, "text", "Human readable text"),
+               clEnumValN(RESULT_JSONL, "jsonl", "One JSON object per line"),
+               clEnumValN(RESULT_BINARY, "binary", "Tagged varint records")),
+    cl::init(RESULT_TEXT));
+
+static cl::opt<std::string> result_file(
+    "result-file",
+    cl::desc("File analysis results are written to instead of stderr"),
+    cl::value_desc("file"), cl::init(""));
+
+static cl::list<std::string> result_functions(
+    "result-functions",
+    cl::desc("Comma separated functions to write analysis results of"),
+    cl::CommaSeparated);
+
+static cl::list<int> result_points(
+    "result-points",
+    cl::desc("Comma separated instruction indices to write analysis "
+             "results at"),
+    cl::CommaSeparated);
+
+static LLVM_THREAD_LOCAL raw_ostream* result_stream = nullptr;
+
+// Opened on first use, closed (and flushed) at exit.
+static raw_ostream& DefaultStream() {
+  static std::unique_ptr<raw_fd_ostream> stream;
+  static bool opened = false;
+
+  if (!opened) {
+    opened = true;
+    if (!result_file.empty()) {
+      std::error_code ec;
+      stream.reset(new raw_fd_ostream(result_file, ec, sys::fs::F_None));
+      if (ec) {
+        errs() << result_file << ": " << ec.message() << '\n';
+        stream.reset();
+      }
+    }
+    if (stream == nullptr) {
+      stream.reset(new raw_fd_ostream(2, false /* shouldClose */));
+    }
+  }
+  return *stream;
+}
+
+raw_ostream& llvm::ResultStream() {
+  return result_stream != nullptr ? *result_stream : DefaultStream();
+}
+
+void llvm::SetResultStream(raw_ostream* os) {
+  result_stream = os;
+}
+
+void llvm::FlushResultStream() {
+  if (result_stream == nullptr) {
+    DefaultStream().flush();
+  }
+}
+
+ResultFormat llvm::GetResultFormat() {
+  return result_format;
+}
+
+bool llvm::WantsResultsOf(StringRef name) {
+  return result_functions.empty() ||
+         std::find(result_functions.begin(), result_functions.end(), name.str()) !=
+             result_functions.end();
+}
+
+bool llvm::WantsResultsAt(int index) {
+  return result_points.empty() ||
+         std::find(result_points.begin(), result_points.end(), index) !=
+             result_points.end();
+}
+
+void llvm::BeginFunctionResults(StringRef name) {
+  if (result_format != RESULT_BINARY) {
+    return;
+  }
+
+  std::string record(1, 'F');
+  WriteVarint(record, name.size());
+  record += name;
+  ResultStream() << record;
+}
+
+void llvm::WriteJSONString(raw_ostream& os, StringRef s) {
+  os << '"';
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      os << '\\' << c;
+    } else if ((unsigned char) c < 0x20) {
+      os << format("\\u%04x", (unsigned) c);
+    } else {
+      os << c;
+    }
+  }
+  os << '"';
+}
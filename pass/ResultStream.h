@@ -0,0 +1,51 @@
+#ifndef LLVM_RESULT_STREAM_H
+#define LLVM_RESULT_STREAM_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace llvm {
+
+// Stream the analysis passes print their results to. It is a buffered
+// stream on stderr, or on -result-file, unless the current thread
+// redirected it, which lets a driver run passes on many modules
+// concurrently and keep their results apart.
+raw_ostream& ResultStream();
+
+// Redirects ResultStream() of the current thread to <os>, or back to the
+// default stream if <os> is null.
+void SetResultStream(raw_ostream* os);
+
+// Writes out what the default stream buffered, so that results printed to
+// stderr stay in order with diagnostics. Passes call it once per function.
+void FlushResultStream();
+
+// How results are written, chosen by -result-format:
+//   text    the human readable output of each pass, the default.
+//   jsonl   one JSON object per line, e.g. for an edge of a dataflow
+//           analysis {"function":"f","src":3,"dst":4,"facts":[1,2]}.
+//   binary  records of a tag byte and varints, facts serialized like in
+//           the analysis cache: 'F' <name size> <name> starts the records
+//           of a function, 'E' <src> <dst> <facts> is an edge of a dataflow
+//           analysis and 'B' <block> <live in> <live out> a block of SSA
+//           liveness.
+enum ResultFormat { RESULT_TEXT, RESULT_JSONL, RESULT_BINARY };
+
+ResultFormat GetResultFormat();
+
+// Whether results are wanted for the function <name>, by -result-functions,
+// and for the input side of the instruction of index <index>, by
+// -result-points. Everything is wanted when they are not given.
+bool WantsResultsOf(StringRef name);
+bool WantsResultsAt(int index);
+
+// Starts the results of the function <name>: writes its 'F' record in the
+// binary format, nothing in the others.
+void BeginFunctionResults(StringRef name);
+
+// Writes <s> as a JSON string.
+void WriteJSONString(raw_ostream& os, StringRef s);
+
+}
+
+#endif
@@ -0,0 +1,80 @@
+#include "Instrumentation.h"
+#include "llvm/Pass.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Module.h"
+
+#include <vector>
+
+using namespace llvm;
+
+namespace {
+
+// Emits, for every function, a table of the addresses at which its blocks
+// start, for the PC sampling runtime (lib/lib_pcs.cc) to map SIGPROF
+// samples back to blocks. Nothing is added to the code itself.
+//
+// The entry block starts at the function; other blocks get their address
+// taken, which keeps them from being merged or deleted later, so the pass
+// belongs at the end of the pipeline. Blocks that cannot have their
+// address taken (EH pads) are left out of the table, their samples go to
+// the block laid out before them.
+struct SampleBlocksPass : public FunctionPass {
+  static char ID;
+  SampleBlocksPass() : FunctionPass(ID) { }
+
+  bool runOnFunction(Function& F) override {
+    if (F.isDeclaration() || IsProfileHelper(F)) {
+      return false;
+    }
+
+    Module& mod = *F.getParent();
+    LLVMContext& ctx = mod.getContext();
+    PointerType* ptr_ty = Type::getInt8PtrTy(ctx);
+    std::vector<Constant*> addresses;
+
+    for (BasicBlock& block : F) {
+      if (&block == &F.getEntryBlock()) {
+        addresses.push_back(ConstantExpr::getBitCast(&F, ptr_ty));
+      } else if (block.isEHPad()) {
+        addresses.push_back(ConstantPointerNull::get(ptr_ty));
+      } else {
+        addresses.push_back(BlockAddress::get(&F, &block));
+      }
+    }
+
+    ArrayType* array_ty = ArrayType::get(ptr_ty, addresses.size());
+    GlobalVariable* table = new GlobalVariable(
+        mod, array_ty, true /* is_constant */, GlobalValue::InternalLinkage,
+        ConstantArray::get(array_ty, addresses), kProfilePrefix + Twine("pcs.") + F.getName());
+
+    Function* registerF = cast<Function>(mod.getOrInsertFunction(
+          "registerSampledFunction",
+          Type::getVoidTy(ctx),
+          Type::getInt64Ty(ctx), /* function hash */
+          Type::getInt64Ty(ctx), /* cfg checksum */
+          Type::getInt8PtrTy(ctx), /* name */
+          Type::getInt32Ty(ctx), /* number of blocks */
+          PointerType::get(ptr_ty, 0), /* block addresses */
+          nullptr));
+
+    IRBuilder<> builder(&CreateRegistrationCtor(table)->getEntryBlock());
+    builder.CreateCall(registerF, {
+        builder.getInt64(ProfileHash(F)), builder.getInt64(CFGChecksum(F)),
+        builder.CreateGlobalStringPtr(ProfileName(F)),
+        builder.getInt32(addresses.size()),
+        builder.CreateConstInBoundsGEP2_64(table, 0, 0)});
+    builder.CreateRetVoid();
+    return true;
+  }
+};
+
+}
+
+char SampleBlocksPass::ID = 0;
+static RegisterPass<SampleBlocksPass> X(
+    "pcs", "Emit block address tables for PC sampling",
+    false /* Only looks at CFG */,
+    false /* Analysis Pass */);
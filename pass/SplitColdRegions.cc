@@ -0,0 +1,189 @@
+#include "ProfileUse.h"
+#include "llvm/Pass.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Transforms/Utils/CodeExtractor.h"
+
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+static cl::opt<unsigned> cold_percent(
+    "split-cold-percent",
+    cl::desc("Treat blocks that ran at most this percentage of the calls of "
+             "their function as cold (default 0: only blocks that never ran)"),
+    cl::init(0));
+
+static cl::opt<unsigned> min_cold_size(
+    "split-cold-min-size",
+    cl::desc("Instructions a cold region needs to be outlined"),
+    cl::init(8));
+
+static cl::opt<std::string> cold_section(
+    "split-cold-section",
+    cl::desc("Section of the outlined cold functions"),
+    cl::init(".text.unlikely"));
+
+namespace {
+
+// Outlines the cold regions of functions, by the block counts of
+// -profile-use, into functions of their own named <function>.cold.<n>.
+// They are marked cold and noinline and placed in -split-cold-section,
+// which linkers gather away from the hot code.
+//
+// A region is grown from a cold block over the cold blocks it dominates,
+// then shrunk until it is entered through that block only. Blocks that
+// return stay in the function, the region branches back to them.
+//
+// The counts of the profile are attached first (see ProfileUse.h), so the
+// outlined blocks keep theirs, and the blocks the extraction adds count the
+// entries into the region.
+struct SplitColdRegionsPass : public FunctionPass {
+  static char ID;
+  SplitColdRegionsPass() : FunctionPass(ID) { }
+
+  void getAnalysisUsage(AnalysisUsage& AU) const override {
+    AU.addRequired<DominatorTreeWrapperPass>();
+  }
+
+  // The cold blocks dominated by <entry> and reached from it through cold
+  // blocks, entered only through <entry>.
+  static std::vector<BasicBlock*> ColdRegion(BasicBlock* entry,
+                                             const DenseSet<BasicBlock*>& cold,
+                                             DominatorTree& DT) {
+    SetVector<BasicBlock*> region;
+    std::vector<BasicBlock*> worklist(1, entry);
+
+    region.insert(entry);
+    while (!worklist.empty()) {
+      BasicBlock* block = worklist.back();
+      worklist.pop_back();
+      for (succ_iterator succ_it = succ_begin(block), succ_e = succ_end(block);
+           succ_it != succ_e; ++succ_it) {
+        if (cold.count(*succ_it) && DT.dominates(entry, *succ_it) &&
+            region.insert(*succ_it)) {
+          worklist.push_back(*succ_it);
+        }
+      }
+    }
+
+    // Blocks also reached from outside the region leave it, until only the
+    // entry is.
+    for (bool changed = true; changed; ) {
+      changed = false;
+      std::vector<BasicBlock*> entered;
+      for (BasicBlock* block : region) {
+        if (block == entry) {
+          continue;
+        }
+        for (pred_iterator pred_it = pred_begin(block), pred_e = pred_end(block);
+             pred_it != pred_e; ++pred_it) {
+          if (!region.count(*pred_it)) {
+            entered.push_back(block);
+            break;
+          }
+        }
+      }
+      for (BasicBlock* block : entered) {
+        region.remove(block);
+        changed = true;
+      }
+    }
+    return std::vector<BasicBlock*>(region.begin(), region.end());
+  }
+
+  bool runOnFunction(Function& F) override {
+    if (UsedProfile() == nullptr || F.isDeclaration()) {
+      return false;
+    }
+    bool changed = AttachProfileCounts(F);
+
+    // The entry block counts the calls.
+    DenseMap<BasicBlock*, uint64_t> counts;
+    BasicBlock* entry = &F.getEntryBlock();
+    if (!GetBlockCounts(F, PROF_BLOCK, counts) || counts.lookup(entry) == 0) {
+      return changed;
+    }
+
+    DominatorTree& DT = getAnalysis<DominatorTreeWrapperPass>().getDomTree();
+
+    // Blocks without a count were added since the profile, and stay.
+    DenseSet<BasicBlock*> cold, original;
+    for (BasicBlock& block : F) {
+      original.insert(&block);
+      if (&block != entry && counts.count(&block) &&
+          counts[&block] * 100 <= counts[entry] * cold_percent &&
+          !isa<ReturnInst>(block.getTerminator())) {
+        cold.insert(&block);
+      }
+    }
+
+    // All regions are formed before the first is extracted, while the
+    // dominator tree is valid. They are disjoint, and each is entered by
+    // its first block only.
+    std::vector<std::vector<BasicBlock*>> regions;
+    DenseSet<BasicBlock*> taken;
+    ReversePostOrderTraversal<Function*> rpo(&F);
+    for (BasicBlock* block : rpo) {
+      if (!cold.count(block) || taken.count(block)) {
+        continue;
+      }
+
+      std::vector<BasicBlock*> region = ColdRegion(block, cold, DT);
+      size_t size = 0;
+      for (BasicBlock* member : region) {
+        taken.insert(member);
+        size += member->size();
+      }
+      if (size >= min_cold_size) {
+        regions.push_back(region);
+      }
+    }
+
+    unsigned n = 0;
+    for (const std::vector<BasicBlock*>& region : regions) {
+      CodeExtractor extractor(region);
+      if (!extractor.isEligible()) {
+        continue;
+      }
+
+      uint64_t entered = counts.lookup(region[0]);
+      Function* outlined = extractor.extractCodeRegion();
+      if (outlined == nullptr) {
+        continue;
+      }
+      outlined->setName(F.getName() + ".cold." + utostr(n++));
+      outlined->addFnAttr(Attribute::Cold);
+      outlined->addFnAttr(Attribute::NoInline);
+      outlined->setSection(cold_section);
+
+      // The blocks the extraction adds to <F>, the call of the region among
+      // them, and the entry of the outlined function.
+      for (BasicBlock& block : F) {
+        if (original.insert(&block).second) {
+          SetBlockCount(&block, PROF_BLOCK, entered);
+        }
+      }
+      SetBlockCount(&outlined->getEntryBlock(), PROF_BLOCK, entered);
+    }
+    return changed || n > 0;
+  }
+};
+
+}
+
+char SplitColdRegionsPass::ID = 0;
+static RegisterPass<SplitColdRegionsPass> X(
+    "split-cold", "Outline cold regions by profile",
+    false /* Only looks at CFG */,
+    false /* Analysis Pass */);
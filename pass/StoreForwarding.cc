@@ -0,0 +1,94 @@
+#include "PointerAnalysis.h"
+#include "ReachingDefinitionAnalysis.h"
+#include "llvm/Pass.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+
+#include <utility>
+#include <vector>
+
+using namespace llvm;
+
+namespace {
+
+// Replaces loads from stack slots by the value stored there, where the
+// memory reaching definitions of MemoryReachingDefinitionAnalysis leave
+// exactly one store into the slot reaching the load. The store must write
+// all of the slot with a value of the loaded type, and dominate the load,
+// so its value is available there.
+struct StoreForwardingPass : public FunctionPass {
+  static char ID;
+  StoreForwardingPass() : FunctionPass(ID) { }
+
+  void getAnalysisUsage(AnalysisUsage& AU) const override {
+    AU.addRequired<DominatorTreeWrapperPass>();
+    AU.addRequired<TargetLibraryInfoWrapperPass>();
+    AU.setPreservesCFG();
+  }
+
+  bool runOnFunction(Function& F) override {
+    if (F.isDeclaration()) {
+      return false;
+    }
+
+    DominatorTree& DT = getAnalysis<DominatorTreeWrapperPass>().getDomTree();
+
+    PointerAnalysis pointers(&getAnalysis<TargetLibraryInfoWrapperPass>().getTLI());
+    pointers.Solve(&F);
+
+    StackSlots slots(&F, pointers);
+    MemoryReachingDefinitionAnalysis reaching(&F, slots);
+    reaching.RunWorklistAlgorithm(&F);
+
+    // All loads are decided on the one solution before any is replaced.
+    std::vector<std::pair<LoadInst*, StoreInst*>> forwarded;
+    for (inst_iterator inst_it = inst_begin(F), inst_e = inst_end(F);
+         inst_it != inst_e; ++inst_it) {
+      LoadInst* load = dyn_cast<LoadInst>(&*inst_it);
+      int slot = load == nullptr ? 0 : slots.WholeSlot(load);
+      if (slot == 0 || !slots.OnlySlots(load) || slots.Accessed(load).size() != 1) {
+        continue;
+      }
+
+      StoreInst* def = nullptr;
+      unsigned n = 0;
+      for (Instruction* store : reaching.StoresInto(slot)) {
+        if (reaching.QueryFact(load, reaching.IndexOf(store))) {
+          def = cast<StoreInst>(store);
+          ++n;
+        }
+      }
+
+      if (n == 1 && slots.WholeSlot(def) == slot &&
+          def->getValueOperand()->getType() == load->getType() &&
+          DT.dominates(def, load)) {
+        forwarded.push_back(std::make_pair(load, def));
+      }
+    }
+
+    // A stored value may itself be a load forwarded before.
+    DenseMap<Value*, Value*> replaced;
+    for (const auto& entry : forwarded) {
+      Value* value = entry.second->getValueOperand();
+      while (replaced.count(value)) {
+        value = replaced[value];
+      }
+
+      entry.first->replaceAllUsesWith(value);
+      replaced[entry.first] = value;
+      entry.first->eraseFromParent();
+    }
+    return !forwarded.empty();
+  }
+};
+
+}
+
+char StoreForwardingPass::ID = 0;
+static RegisterPass<StoreForwardingPass> X(
+    "store-forward", "Forward stored values to loads of stack slots",
+    false /* Only looks at CFG */,
+    false /* Analysis Pass */);
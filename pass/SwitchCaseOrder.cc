@@ -0,0 +1,160 @@
+#include "ProfileUse.h"
+#include "llvm/Pass.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/Support/CommandLine.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+using namespace llvm;
+
+static cl::opt<unsigned> peel_percent(
+    "switch-peel-percent",
+    cl::desc("Test a switch case ahead of the switch if it takes at least "
+             "this percentage of the executions of the switch"),
+    cl::init(40));
+
+namespace {
+
+// Orders the cases of switches by the PROF_SWITCH counts of -profile-use.
+// Cases taking at least -switch-peel-percent of the executions are peeled
+// into compare-and-branch checks in front of the switch, most frequent
+// first, and every remaining switch gets the counts as branch weights,
+// which the lowering uses to test hot cases first.
+//
+// The counts of the profile are attached first (see ProfileUse.h), and
+// the blocks and switches the peeling changes get counts of their own.
+struct SwitchCaseOrderPass : public FunctionPass {
+  static char ID;
+  SwitchCaseOrderPass() : FunctionPass(ID) { }
+
+  // Branch weights are 32-bit, counts are divided by <scale> to fit.
+  static uint32_t Weight(uint64_t count, uint64_t scale) {
+    return count / scale;
+  }
+
+  // Peels the case <value> of <sw> into a check ahead of it, which the
+  // switch passed <taken> times to the case and <rest> times to others.
+  static void PeelCase(SwitchInst* sw, ConstantInt* value, uint64_t taken, uint64_t rest) {
+    BasicBlock* block = sw->getParent();
+    SwitchInst::CaseIt case_it = sw->findCaseValue(value);
+    BasicBlock* dest = case_it.getCaseSuccessor();
+
+    // The switch moves to a block of its own, left by <block> for the
+    // cases that are not peeled.
+    BasicBlock* rest_block = block->splitBasicBlock(sw->getIterator(), "switch.rest");
+    TerminatorInst* br = block->getTerminator();
+    IRBuilder<> builder(br);
+    uint64_t scale = std::max(taken, rest) / UINT32_MAX + 1;
+    builder.CreateCondBr(builder.CreateICmpEQ(sw->getCondition(), value, "switch.peel"),
+                         dest, rest_block,
+                         MDBuilder(block->getContext()).createBranchWeights(
+                             Weight(taken, scale), Weight(rest, scale)));
+    br->eraseFromParent();
+
+    // The check runs as often as the switch did, the switch now only for
+    // the other cases.
+    for (prof_kind kind : {PROF_BLOCK, PROF_SAMPLES}) {
+      uint64_t count;
+      if (GetBlockCount(rest_block, kind, count)) {
+        SetBlockCount(block, kind, count);
+        SetBlockCount(rest_block, kind, (uint64_t) ((double) count * rest / (taken + rest)));
+      }
+    }
+
+    // <dest> loses one edge from the switch and gains the check.
+    for (BasicBlock::iterator inst_it = dest->begin(); isa<PHINode>(inst_it); ++inst_it) {
+      PHINode* phi = cast<PHINode>(inst_it);
+      phi->addIncoming(phi->getIncomingValueForBlock(rest_block), block);
+      phi->removeIncomingValue(rest_block, false /* DeletePHIIfEmpty */);
+    }
+    sw->removeCase(case_it);
+  }
+
+  bool runOnFunction(Function& F) override {
+    if (UsedProfile() == nullptr || F.isDeclaration()) {
+      return false;
+    }
+    bool changed = AttachProfileCounts(F);
+
+    // The switches are collected before the first peel adds blocks.
+    std::vector<std::pair<SwitchInst*, std::vector<uint64_t>>> switches;
+    for (BasicBlock& block : F) {
+      SwitchInst* sw = dyn_cast<SwitchInst>(block.getTerminator());
+      std::vector<uint64_t> counts;
+
+      if (sw != nullptr && GetSwitchCounts(sw, counts)) {
+        switches.push_back(std::make_pair(sw, counts));
+      }
+    }
+
+    for (auto& entry : switches) {
+      SwitchInst* sw = entry.first;
+      const std::vector<uint64_t>& counts = entry.second;
+
+      uint64_t total = 0;
+      for (uint64_t count : counts) {
+        total += count;
+      }
+      if (total == 0) {
+        continue;
+      }
+      uint64_t scale = total / UINT32_MAX + 1;
+
+      // Successor i is case i - 1, so the values are taken before any case
+      // is removed.
+      DenseMap<ConstantInt*, uint64_t> case_counts;
+      std::vector<std::pair<uint64_t, ConstantInt*>> cases;
+      for (SwitchInst::CaseIt case_it = sw->case_begin(); case_it != sw->case_end(); ++case_it) {
+        uint64_t count = counts[case_it.getSuccessorIndex()];
+        case_counts[case_it.getCaseValue()] = count;
+        cases.push_back(std::make_pair(count, case_it.getCaseValue()));
+      }
+      std::stable_sort(cases.begin(), cases.end(),
+                       [](const std::pair<uint64_t, ConstantInt*>& a,
+                          const std::pair<uint64_t, ConstantInt*>& b) {
+                         return a.first > b.first;
+                       });
+
+      // Cases that never ran are not peeled, even at -switch-peel-percent=0.
+      uint64_t left = total;
+      for (const auto& c : cases) {
+        if (c.first == 0 || c.first * 100 < total * peel_percent) {
+          break;
+        }
+        left -= c.first;
+        PeelCase(sw, c.second, c.first, left);
+        changed = true;
+      }
+
+      // Counts and weights of what is left of the switch, default first.
+      std::vector<uint64_t> left_counts(1, counts[0]);
+      std::vector<uint32_t> weights(1, Weight(counts[0], scale));
+      for (SwitchInst::CaseIt case_it = sw->case_begin(); case_it != sw->case_end(); ++case_it) {
+        left_counts.push_back(case_counts[case_it.getCaseValue()]);
+        weights.push_back(Weight(case_counts[case_it.getCaseValue()], scale));
+      }
+      SetSwitchCounts(sw, left_counts);
+      sw->setMetadata(LLVMContext::MD_prof,
+                      MDBuilder(F.getContext()).createBranchWeights(weights));
+      changed = true;
+    }
+
+    return changed;
+  }
+};
+
+}
+
+char SwitchCaseOrderPass::ID = 0;
+static RegisterPass<SwitchCaseOrderPass> X(
+    "switch-order", "Order switch cases by profile",
+    false /* Only looks at CFG */,
+    false /* Analysis Pass */);
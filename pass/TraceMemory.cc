@@ -0,0 +1,133 @@
+#include "Instrumentation.h"
+#include "llvm/Pass.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+
+#include <vector>
+
+using namespace llvm;
+
+namespace {
+
+// Samples the addresses of loads and stores into a trace (see
+// lib/lib_trace.cc), analyzed offline by llvm-pass-memtrace. Every access
+// decrements a thread local countdown inline and only calls the runtime
+// when it runs out, so unsampled accesses cost a few instructions.
+struct TraceMemoryPass : public FunctionPass {
+  static char ID;
+  TraceMemoryPass() : FunctionPass(ID) { }
+
+  // Accesses of the instrumentation itself are not traced.
+  static bool IsTraced(Instruction& inst) {
+    Value* ptr = nullptr;
+
+    if (LoadInst* load = dyn_cast<LoadInst>(&inst)) {
+      ptr = load->getPointerOperand();
+    } else if (StoreInst* store = dyn_cast<StoreInst>(&inst)) {
+      ptr = store->getPointerOperand();
+    } else {
+      return false;
+    }
+
+    GlobalVariable* global = dyn_cast<GlobalVariable>(ptr->stripPointerCasts());
+    return global == nullptr || !global->getName().startswith(kProfilePrefix);
+  }
+
+  bool runOnFunction(Function& F) override {
+    if (F.isDeclaration() || IsProfileHelper(F)) {
+      return false;
+    }
+
+    std::vector<Instruction*> accesses;
+    for (inst_iterator inst_it = inst_begin(F), inst_e = inst_end(F);
+         inst_it != inst_e; ++inst_it) {
+      if (IsTraced(*inst_it)) {
+        accesses.push_back(&*inst_it);
+      }
+    }
+    if (accesses.empty()) {
+      return false;
+    }
+
+    Module& mod = *F.getParent();
+    LLVMContext& ctx = mod.getContext();
+    const DataLayout& layout = mod.getDataLayout();
+
+    // Identify the function by the CFG it had before the sampling checks
+    // split its blocks.
+    uint64_t hash = ProfileHash(F);
+    uint64_t checksum = CFGChecksum(F);
+
+    Function* registerF = cast<Function>(mod.getOrInsertFunction(
+          "registerTraceFunction",
+          Type::getVoidTy(ctx),
+          Type::getInt64Ty(ctx), /* function hash */
+          Type::getInt64Ty(ctx), /* cfg checksum */
+          Type::getInt8PtrTy(ctx), /* name */
+          Type::getInt32Ty(ctx), /* number of sites */
+          nullptr));
+    Function* traceF = cast<Function>(mod.getOrInsertFunction(
+          "traceMemoryAccess",
+          Type::getVoidTy(ctx),
+          Type::getInt64Ty(ctx), /* function hash */
+          Type::getInt32Ty(ctx), /* site */
+          Type::getInt32Ty(ctx), /* size and kind */
+          Type::getInt8PtrTy(ctx), /* address */
+          nullptr));
+
+    GlobalVariable* countdown = mod.getGlobalVariable("__prof_trace_countdown");
+    if (countdown == nullptr) {
+      countdown = new GlobalVariable(
+          mod, Type::getInt32Ty(ctx), false /* is_constant */,
+          GlobalValue::ExternalLinkage, nullptr, "__prof_trace_countdown",
+          nullptr, GlobalVariable::GeneralDynamicTLSModel);
+    }
+
+    IRBuilder<> builder(&CreateRegistrationCtor(mod, "trace." + F.getName())->getEntryBlock());
+    builder.CreateCall(registerF, {
+        builder.getInt64(hash), builder.getInt64(checksum),
+        builder.CreateGlobalStringPtr(ProfileName(F)),
+        builder.getInt32(accesses.size())});
+    builder.CreateRetVoid();
+
+    MDNode* unlikely = MDBuilder(ctx).createBranchWeights(1, 1000);
+
+    for (size_t i = 0; i < accesses.size(); ++i) {
+      Instruction* access = accesses[i];
+      bool is_store = isa<StoreInst>(access);
+      Value* ptr = is_store ? cast<StoreInst>(access)->getPointerOperand() :
+                              cast<LoadInst>(access)->getPointerOperand();
+      Type* type = cast<PointerType>(ptr->getType())->getElementType();
+      uint32_t info = layout.getTypeStoreSize(type) << 1 | (is_store ? TRACE_STORE : 0);
+
+      builder.SetInsertPoint(access);
+      Value* left = builder.CreateSub(builder.CreateLoad(countdown), builder.getInt32(1));
+      builder.CreateStore(left, countdown);
+
+      TerminatorInst* sample = SplitBlockAndInsertIfThen(
+          builder.CreateICmpSLT(left, builder.getInt32(0)), access,
+          false /* Unreachable */, unlikely);
+      builder.SetInsertPoint(sample);
+      builder.CreateCall(traceF, {
+          builder.getInt64(hash), builder.getInt32(i), builder.getInt32(info),
+          builder.CreatePointerCast(ptr, builder.getInt8PtrTy())});
+    }
+
+    return true;
+  }
+};
+
+}
+
+char TraceMemoryPass::ID = 0;
+static RegisterPass<TraceMemoryPass> X(
+    "mt", "Trace sampled memory accesses",
+    false /* Only looks at CFG */,
+    false /* Analysis Pass */);
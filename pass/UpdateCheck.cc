@@ -0,0 +1,138 @@
+#include "LivenessAnalysis.h"
+#include "ReachingDefinitionAnalysis.h"
+#include "ResultStream.h"
+#include "llvm/Pass.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/InstrTypes.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+
+#include <vector>
+
+using namespace llvm;
+
+namespace {
+
+// Checks the incremental re-analysis of the dataflow analyses. Reaching
+// definitions and liveness are solved, then the function is edited while
+// both are notified: every binary operation is replaced by a copy, and
+// every block is split in two. The branch the split adds is not reported,
+// UpdateAnalysis() finds it in a dirty block. The updated facts on the
+// input side of each instruction are then compared with those of a full
+// solve of the edited function.
+//
+// Prints "<analysis> <function>: ok" or the number of mismatching facts.
+// The edits keep the meaning of the program, so the pass can run in front
+// of other passes too.
+struct UpdateCheckPass : public FunctionPass {
+  static char ID;
+  UpdateCheckPass() : FunctionPass(ID) { }
+
+  template <typename Analysis>
+  static unsigned CountMismatches(Function& F, Analysis& updated) {
+    Analysis fresh;
+    unsigned n = 0;
+
+    fresh.RunWorklistAlgorithm(&F);
+    for (BasicBlock& block : F) {
+      for (Instruction& I : block) {
+        auto updated_info = updated.InputInfo(&I);
+        auto fresh_info = fresh.InputInfo(&I);
+
+        n += updated_info.size() != fresh_info.size();
+        for (BasicBlock& def_block : F) {
+          for (Instruction& def : def_block) {
+            n += updated_info.contains(updated.IndexOf(&def)) !=
+                 fresh_info.contains(fresh.IndexOf(&def));
+          }
+        }
+      }
+    }
+    return n;
+  }
+
+  static void Report(StringRef analysis, Function& F, unsigned mismatches) {
+    ResultStream() << analysis << ' ' << F.getName() << ": ";
+    if (mismatches == 0) {
+      ResultStream() << "ok\n";
+    } else {
+      ResultStream() << mismatches << " mismatches\n";
+    }
+  }
+
+  bool runOnFunction(Function& F) override {
+    if (F.isDeclaration()) {
+      return false;
+    }
+
+    ReachingDefinitionAnalysis reaching;
+    LivenessAnalysis liveness;
+    reaching.RunWorklistAlgorithm(&F);
+    liveness.RunWorklistAlgorithm(&F);
+
+    std::vector<BinaryOperator*> binaries;
+    for (BasicBlock& block : F) {
+      for (Instruction& I : block) {
+        if (BinaryOperator* binary = dyn_cast<BinaryOperator>(&I)) {
+          binaries.push_back(binary);
+        }
+      }
+    }
+    for (BinaryOperator* binary : binaries) {
+      BinaryOperator* copy = BinaryOperator::Create(
+          binary->getOpcode(), binary->getOperand(0), binary->getOperand(1),
+          binary->getName(), binary);
+      reaching.NotifyInstructionInserted(copy);
+      liveness.NotifyInstructionInserted(copy);
+
+      for (User* user : binary->users()) {
+        reaching.NotifyInstructionChanged(cast<Instruction>(user));
+        liveness.NotifyInstructionChanged(cast<Instruction>(user));
+      }
+      binary->replaceAllUsesWith(copy);
+      reaching.NotifyInstructionRemoved(binary);
+      liveness.NotifyInstructionRemoved(binary);
+      binary->eraseFromParent();
+    }
+
+    std::vector<BasicBlock*> blocks;
+    for (BasicBlock& block : F) {
+      blocks.push_back(&block);
+    }
+    for (BasicBlock* block : blocks) {
+      BasicBlock::iterator split = block->begin();
+      std::advance(split, block->size() / 2);
+      if (isa<PHINode>(split)) {
+        split = block->getFirstNonPHI()->getIterator();
+      }
+
+      std::vector<BasicBlock*> succs(succ_begin(block), succ_end(block));
+      BasicBlock* tail = SplitBlock(block, &*split);
+
+      reaching.NotifyEdgeInserted(block, tail);
+      liveness.NotifyEdgeInserted(block, tail);
+      for (BasicBlock* succ : succs) {
+        reaching.NotifyEdgeRemoved(block, succ);
+        liveness.NotifyEdgeRemoved(block, succ);
+        reaching.NotifyEdgeInserted(tail, succ);
+        liveness.NotifyEdgeInserted(tail, succ);
+      }
+    }
+
+    reaching.UpdateAnalysis(&F);
+    liveness.UpdateAnalysis(&F);
+    Report("reaching", F, CountMismatches(F, reaching));
+    Report("liveness", F, CountMismatches(F, liveness));
+    FlushResultStream();
+    return true;
+  }
+};
+
+}
+
+char UpdateCheckPass::ID = 0;
+static RegisterPass<UpdateCheckPass> X(
+    "dfa-update-check", "Check incremental dataflow updates against a full solve",
+    false /* Only looks at CFG */,
+    false /* Analysis Pass */);
@@ -7,12 +7,96 @@ clang++ -c test/test1-main.cc -emit-llvm -S -o build/test1-main.ll
 # Compile libs to LLVM IR.
 clang++ -c lib/lib_cdi.cc -emit-llvm -S -o build/lib_cdi.ll
 clang++ -c lib/lib_bb.cc -emit-llvm -S -o build/lib_bb.ll
+clang++ -c lib/lib_prof.cc -emit-llvm -S -o build/lib_prof.ll
+clang++ -c lib/lib_cov.cc -emit-llvm -S -o build/lib_cov.ll
+clang++ -c lib/lib_trace.cc -emit-llvm -S -o build/lib_trace.ll
+clang++ -c lib/lib_pcs.cc -emit-llvm -S -o build/lib_pcs.ll
 
 # Run LLVM IR through our LLVM passes.
 opt -load pass/LLVMPass.so -csi < build/test1.ll > /dev/null 2> build/csi.result
 opt -load pass/LLVMPass.so -cdi < build/test1.ll -o build/test1-cdi.bc
 opt -load pass/LLVMPass.so -bb < build/test1.ll -o build/test1-bb.bc
 
+# Check incremental dataflow updates against a full solve.
+opt -load pass/LLVMPass.so -dfa-update-check < build/test1.ll > /dev/null 2> build/update.result
+if grep -q mismatches build/update.result; then
+  echo "dfa-update-check failed, see build/update.result"
+  exit 1
+fi
+
+# Rebuilds test program $1 with the passes that follow and checks that it
+# prints what the untransformed program printed.
+check_output() {
+  local name=$1
+  shift
+  opt -load pass/LLVMPass.so "$@" < build/$name.ll -o build/$name-opt.bc
+  clang build/$name-opt.bc -o build/$name-opt
+  build/$name-opt > build/$name.actual
+  if ! cmp -s build/$name.expected build/$name.actual; then
+    echo "$name: $* changed the output"
+    exit 1
+  fi
+}
+
+# Transforms must not change what the test programs print: each is run
+# alone and chained, and the output compared with the untransformed program.
+# The profile guided ones use a profile of the program itself.
+transforms=("-slot-dse" "-store-forward" "-heap-to-stack" "-store-forward -slot-dse"
+            "-heap-to-stack -store-forward -slot-dse")
+profiled=("-switch-order" "-switch-order -switch-peel-percent=0" "-block-layout" "-split-cold"
+          "-split-cold -split-cold-percent=50" "-inline-advice -always-inline"
+          "-switch-order -split-cold -inline-advice -always-inline -block-layout")
+for src in test/transform-*.c; do
+  name=$(basename $src .c)
+  clang -c -O0 $src -emit-llvm -S -o build/$name.ll
+  clang build/$name.ll -o build/$name
+  build/$name > build/$name.expected
+
+  for passes in "${transforms[@]}"; do
+    check_output $name $passes
+  done
+
+  opt -load pass/LLVMPass.so -csc -cdi -cdi-blocks -bb -bb-switches < build/$name.ll \
+      -o build/$name-prof.bc
+  clang++ build/$name-prof.bc build/lib_prof.ll build/lib_bb.ll -o build/$name-prof
+  rm -f build/$name.prof
+  LLVM_PASS_PROFILE=build/$name.prof build/$name-prof > /dev/null 2>&1
+  for passes in "${profiled[@]}"; do
+    check_output $name $passes -profile-use=build/$name.prof
+  done
+done
+
+# The sparse pointer analysis must give the same answers as the worklist,
+# both printed and as seen by the analyses that resolve pointers with it.
+analyses=("-pointer" "-liveness -liveness-slots" "-reaching -reaching-memory")
+for input in build/test1.ll build/transform-*.ll; do
+  for passes in "${analyses[@]}"; do
+    opt -load pass/LLVMPass.so $passes < $input > /dev/null 2> build/dense.result
+    opt -load pass/LLVMPass.so $passes -pointer-sparse < $input > /dev/null 2> build/sparse.result
+    if ! cmp -s build/dense.result build/sparse.result; then
+      echo "$input: $passes differs with -pointer-sparse"
+      exit 1
+    fi
+  done
+done
+
+# Cached dataflow results must match a fresh solve, both on the run that
+# fills the cache and on the one that reads it. The inputs share the cache.
+rm -rf build/dfa-cache
+for input in build/test1.ll build/transform-*.ll; do
+  for pass in -liveness -reaching -pointer; do
+    opt -load pass/LLVMPass.so $pass < $input > /dev/null 2> build/uncached.result
+    for run in fill reuse; do
+      opt -load pass/LLVMPass.so $pass -dfa-cache-dir=build/dfa-cache < $input \
+          > /dev/null 2> build/cached.result
+      if ! cmp -s build/uncached.result build/cached.result; then
+        echo "$input: $pass differs with -dfa-cache-dir ($run)"
+        exit 1
+      fi
+    done
+  done
+done
+
 # Disassmble bitcode to human readable IR.
 llvm-dis build/test1-cdi.bc
 llvm-dis build/test1-bb.bc
@@ -24,3 +108,87 @@ clang++ build/test1-bb.ll build/lib_bb.ll build/test1-main.ll -o build/bb_test1
 # Execute hijacked programs.
 build/cdi_test1 2> build/cdi.result
 build/bb_test1 2> build/bb.result
+
+# Profiling runtimes and their tools, on a test program with loops and
+# calls. Merging a profile with itself doubles every count and histogram
+# bucket; merging a coverage bitmap with itself leaves it as it was.
+opt -load pass/LLVMPass.so -csc -cdi -cdi-blocks -vp -ltc < build/transform-profile.ll \
+    -o build/prof_test.bc
+clang++ build/prof_test.bc build/lib_prof.ll -o build/prof_test
+rm -f build/prof_test.prof
+LLVM_PASS_PROFILE=build/prof_test.prof build/prof_test > /dev/null
+if ! tools/llvm-pass-profmerge -o build/once.prof -top 1000 build/prof_test.prof \
+         > build/once.top ||
+   ! tools/llvm-pass-profmerge -o build/twice.prof -top 1000 build/prof_test.prof \
+         build/prof_test.prof > build/twice.top; then
+  echo "llvm-pass-profmerge failed"
+  exit 1
+fi
+awk 'BEGIN { FS = OFS = "\t" }
+     /^ / { $1 = "  " 2 * $1 }
+     /loop at block/ {
+       n = split($NF, bucket, / /)
+       $NF = ""
+       for (i = 1; i <= n; ++i) {
+         split(bucket[i], kv, /:/)
+         $NF = $NF (i > 1 ? " " : "") kv[1] ":" 2 * kv[2]
+       }
+     }
+     { print }' build/once.top > build/doubled.top
+if ! cmp -s build/doubled.top build/twice.top; then
+  echo "llvm-pass-profmerge: counts do not double, see build/twice.top"
+  exit 1
+fi
+
+opt -load pass/LLVMPass.so -cdi -cdi-coverage < build/transform-profile.ll -o build/cov_test.bc
+clang++ build/cov_test.bc build/lib_cov.ll -o build/cov_test
+rm -f build/cov_test.cov
+LLVM_PASS_COVERAGE=build/cov_test.cov build/cov_test > /dev/null
+if ! tools/llvm-pass-profmerge -coverage -o build/once.cov -top 1000 build/cov_test.cov \
+         > build/once.ctop ||
+   ! tools/llvm-pass-profmerge -coverage -o build/twice.cov -top 1000 build/cov_test.cov \
+         build/cov_test.cov > build/twice.ctop ||
+   ! cmp -s build/once.cov build/twice.cov || ! cmp -s build/once.ctop build/twice.ctop; then
+  echo "llvm-pass-profmerge -coverage: merging a bitmap with itself changed it"
+  exit 1
+fi
+
+opt -load pass/LLVMPass.so -mt < build/transform-profile.ll -o build/mt_test.bc
+clang++ build/mt_test.bc build/lib_trace.ll -lpthread -o build/mt_test
+rm -f build/mt_test.trace
+LLVM_PASS_TRACE=build/mt_test.trace LLVM_PASS_TRACE_PERIOD=10 build/mt_test > /dev/null
+if ! tools/llvm-pass-memtrace build/mt_test.trace > build/memtrace.result ||
+   ! grep -q load build/memtrace.result; then
+  echo "llvm-pass-memtrace failed, see build/memtrace.result"
+  exit 1
+fi
+
+opt -load pass/LLVMPass.so -pcs < build/transform-profile.ll -o build/pcs_test.bc
+clang++ build/pcs_test.bc build/lib_pcs.ll build/lib_prof.ll -ldl -o build/pcs_test
+rm -f build/pcs_test.prof
+LLVM_PASS_PROFILE=build/pcs_test.prof LLVM_PASS_SAMPLE_INTERVAL=10 build/pcs_test > /dev/null
+if ! tools/llvm-pass-profmerge -o build/pcs_merged.prof build/pcs_test.prof; then
+  echo "llvm-pass-profmerge: cannot read the PC sample profile"
+  exit 1
+fi
+
+# The batch driver must print what opt prints for the same passes, both on
+# whole modules and streaming one function at a time.
+rm -rf build/batch build/batch-stream
+if ! tools/llvm-pass-run -passes=liveness,reaching,pointer,csi -o build/batch build/*.bc ||
+   ! tools/llvm-pass-run -passes=liveness,reaching,pointer,csi -stream -o build/batch-stream \
+         build/*.bc; then
+  echo "llvm-pass-run failed"
+  exit 1
+fi
+for input in build/*.bc; do
+  name=$(basename $input)
+  opt -load pass/LLVMPass.so -liveness -reaching -pointer -csi < $input > /dev/null \
+      2> build/batch.expected
+  for out in build/batch build/batch-stream; do
+    if ! cmp -s build/batch.expected $out/$name.result; then
+      echo "$input: llvm-pass-run differs from opt, see $out/$name.result"
+      exit 1
+    fi
+  done
+done
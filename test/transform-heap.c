@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+// Heap allocations and their frees, for -heap-to-stack.
+
+int* leaked;
+
+int local_malloc(int v) {
+  int* p = malloc(4 * sizeof(int));
+  p[0] = v;
+  p[1] = v * 2;
+  p[2] = p[0] + p[1];
+  p[3] = 0;
+  int r = p[2];
+  free(p);
+  return r;
+}
+
+int zeroed(int n) {
+  int* a = calloc(8, sizeof(int));
+  for (int i = 0; i < 8; i += 2) {
+    a[i] = i + n;
+  }
+  int s = 0;
+  for (int i = 0; i < 8; ++i) {
+    s = s * 3 + a[i];
+  }
+  free(a);
+  return s;
+}
+
+int freed_on_both_paths(int c) {
+  char* buf = calloc(32, 1);
+  if (c) {
+    buf[3] = 'x';
+    int r = buf[3] + buf[4];
+    free(buf);
+    return r;
+  }
+  int r = buf[5];
+  free(buf);
+  return r;
+}
+
+int either(int c) {
+  int* a = malloc(sizeof(int));
+  int* b = malloc(sizeof(int));
+  *a = 1;
+  *b = 2;
+  int* p = c ? a : b;
+  int r = *p;
+  free(p);
+  free(c ? b : a);
+  return r;
+}
+
+int escapes(int v) {
+  int* p = malloc(sizeof(int));
+  *p = v;
+  leaked = p;
+  return *leaked;
+}
+
+int in_loop(int n) {
+  int s = 0;
+  for (int i = 0; i < n; ++i) {
+    int* p = malloc(4 * sizeof(int));
+    p[0] = i;
+    s += p[0];
+    free(p);
+  }
+  return s;
+}
+
+// The cycle first -> second -> first is entered at both blocks, so it is
+// not a natural loop. Each trip reads the object of the trip before.
+int irreducible(int n) {
+  int* prev;
+  int have = 0;
+  int s = 0;
+  int i = 0;
+  if (n > 2) {
+    goto second;
+  }
+first: {
+    int* p = malloc(sizeof(int));
+    *p = i;
+    if (have) {
+      s = s * 10 + *prev;
+      free(prev);
+    }
+    prev = p;
+    have = 1;
+  }
+second:
+  if (++i < n) {
+    goto first;
+  }
+  if (have) {
+    s = s * 10 + *prev;
+    free(prev);
+  }
+  return s;
+}
+
+int main() {
+  for (int i = 0; i < 6; ++i) {
+    printf("%d %d %d %d %d %d %d\n", local_malloc(i), zeroed(i), freed_on_both_paths(i & 1),
+           either(i & 1), escapes(i), in_loop(i), irreducible(i));
+    free(leaked);
+  }
+  return 0;
+}
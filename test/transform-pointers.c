@@ -0,0 +1,61 @@
+#include <stdio.h>
+
+// Pointers to stack slots kept in other slots, for -store-forward and
+// -slot-dse.
+
+int* kept;
+
+int redirect(int a, int b) {
+  int x = a;
+  int y = b;
+  int* p = &x;
+  int** pp = &p;
+  *pp = &y;
+  *p = 42;
+  return x * 100 + y;
+}
+
+int choose(int c) {
+  int x = 1;
+  int y = 2;
+  int* p = c ? &x : &y;
+  *p = 9;
+  return x + 10 * y;
+}
+
+int swap_through(int a, int b) {
+  int x = a;
+  int y = b;
+  int* p = &x;
+  int* q = &y;
+  int t = *p;
+  *p = *q;
+  *q = t;
+  return x * 1000 + y;
+}
+
+int escaped(int v) {
+  int x = v;
+  kept = &x;
+  *kept += 1;
+  return x;
+}
+
+int pointer_loop(int n) {
+  int a = 0;
+  int b = 0;
+  int* p = &a;
+  for (int i = 0; i < n; ++i) {
+    *p += i;
+    p = (p == &a) ? &b : &a;
+  }
+  return a * 1000 + b;
+}
+
+int main() {
+  for (int i = 0; i < 6; ++i) {
+    printf("%d %d %d %d %d\n", redirect(i, i + 1), choose(i & 1), swap_through(i, 7 - i),
+           escaped(i * 3), pointer_loop(i * 2));
+  }
+  return 0;
+}
@@ -0,0 +1,56 @@
+#include <stdio.h>
+
+// A switch with a hot case, cold paths and hot calls, for the profile
+// guided transforms.
+
+int square(int x) {
+  return x * x;
+}
+
+int classify(int v) {
+  switch (v & 7) {
+  case 0:
+    return 10;
+  case 3:
+    return square(v);
+  case 5:
+  case 6:
+    return v - 1;
+  default:
+    return v + 1;
+  }
+}
+
+int checked(int v, int limit) {
+  if (v > limit) {
+    int a = v * 7;
+    int b = a ^ 12345;
+    int c = (a + b) % 97;
+    printf("over %d %d %d\n", a, b, c);
+    return c;
+  }
+  return v;
+}
+
+int sum(int n) {
+  int s = 0;
+  for (int i = 0; i < n; ++i) {
+    if (i % 3 == 0) {
+      s += classify(i % 6 == 0 ? 3 : i);
+    } else {
+      s += square(i & 7);
+    }
+    if (s < 0) {
+      printf("negative %d\n", s);
+      s = -s * 3 + 1;
+    }
+  }
+  return s;
+}
+
+int main() {
+  for (int i = 0; i < 6; ++i) {
+    printf("%d %d %d\n", classify(i * 3), checked(i * 2, 6), sum(i * 10));
+  }
+  return 0;
+}
@@ -0,0 +1,85 @@
+#include <stdio.h>
+
+// Stores that write part of a stack slot, for -slot-dse and -store-forward.
+
+struct pair {
+  int lo;
+  int hi;
+};
+
+union word {
+  unsigned whole;
+  unsigned char bytes[4];
+};
+
+int fields(int a, int b) {
+  struct pair p;
+  p.lo = a;
+  p.hi = b;
+  p.lo = p.lo + p.hi;
+  return p.lo * 3 + p.hi;
+}
+
+unsigned bytes_over_whole(unsigned x) {
+  union word w;
+  w.whole = x;
+  w.bytes[1] = 0xab;
+  return w.whole;
+}
+
+unsigned whole_over_bytes(unsigned x) {
+  union word w;
+  w.bytes[0] = 1;
+  w.bytes[3] = 2;
+  w.whole = x;
+  return w.whole + w.bytes[0];
+}
+
+int through_char(int v) {
+  int x = v;
+  char* p = (char*) &x;
+  p[0] = 7;
+  return x;
+}
+
+int overwritten(int a) {
+  int x = a;
+  x = a * 2;
+  int y = x;
+  if (a > 3) {
+    y = a;
+  }
+  return x + y;
+}
+
+int array_elements(int i) {
+  int a[4];
+  a[0] = 1;
+  a[1] = 2;
+  a[2] = 3;
+  a[3] = 4;
+  a[i & 3] = 10;
+  a[0] = a[0] + a[1];
+  return a[0] + a[1] + a[2] + a[3];
+}
+
+int loop_sum(int n) {
+  int s = 0;
+  for (int i = 0; i < n; ++i) {
+    if (i & 1) {
+      s += i;
+    } else {
+      s -= 1;
+    }
+  }
+  return s;
+}
+
+int main() {
+  for (int i = 0; i < 6; ++i) {
+    printf("%d %u %u %d %d %d %d\n", fields(i, i * 7), bytes_over_whole(0x01020304u * i),
+           whole_over_bytes(0x01020304u + i), through_char(0x1000 * i + 300),
+           overwritten(i), array_elements(i), loop_sum(i * 5));
+  }
+  return 0;
+}
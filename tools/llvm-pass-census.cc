@@ -0,0 +1,226 @@
+// Static instruction census over a corpus of bitcode files, the corpus
+// counterpart of the csi pass.
+//
+//   llvm-pass-census -j 8 -o census corpus/
+//
+// Every .bc file below the corpus directory is counted on a pool of worker
+// threads. Each module gets a tab separated table <out>/<module>.csi.tsv,
+// <module> being its path below the corpus, with one row per function and a
+// final row for the whole module, and <out>/totals.tsv has one row per
+// module, named by the same path, and a final row for the corpus.
+// All tables share the header "name" followed by one column per opcode.
+
+#include "CountStaticInst.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Mutex.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/PrettyStackTrace.h"
+#include "llvm/Support/Signals.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace llvm;
+
+static cl::opt<std::string> corpus_dir(
+    cl::Positional, cl::desc("<corpus directory>"), cl::Required);
+
+static cl::opt<std::string> output_dir(
+    "o", cl::desc("Directory receiving the tables"),
+    cl::value_desc("directory"), cl::init("."));
+
+static cl::opt<unsigned> num_jobs(
+    "j", cl::desc("Number of worker threads (default: all cores)"),
+    cl::init(0));
+
+static sys::Mutex diag_lock;
+
+// Corpus-wide counters. Workers add a whole module at once, so the
+// contention on each counter is one atomic add per module.
+static std::atomic<uint64_t> total_count[kNumOpcodes];
+
+static void ReportError(StringRef file, const Twine& msg) {
+  sys::ScopedLock lock(diag_lock);
+  errs() << file << ": " << msg << '\n';
+}
+
+static void PrintHeader(raw_ostream& os) {
+  os << "name";
+  for (unsigned op = 1; op < kNumOpcodes; ++op) {
+    os << '\t' << Instruction::getOpcodeName(op);
+  }
+  os << '\n';
+}
+
+static void PrintRow(raw_ostream& os, StringRef name, const uint64_t* counts) {
+  os << name;
+  for (unsigned op = 1; op < kNumOpcodes; ++op) {
+    os << '\t' << counts[op];
+  }
+  os << '\n';
+}
+
+// Collects the .bc files below <dir>.
+static std::vector<std::string> FindBitcodeFiles(StringRef dir) {
+  std::vector<std::string> files;
+  std::error_code ec;
+
+  for (sys::fs::recursive_directory_iterator it(dir, ec), e; it != e && !ec;
+       it.increment(ec)) {
+    if (sys::path::extension(it->path()) == ".bc") {
+      files.push_back(it->path());
+    }
+  }
+  if (ec) {
+    ReportError(dir, ec.message());
+  }
+  std::sort(files.begin(), files.end());
+  return files;
+}
+
+// Path of <file> below the corpus directory.
+static std::string RelativeName(StringRef file) {
+  StringRef name = file.drop_front(std::min(file.size(), corpus_dir.size()));
+  while (!name.empty() && sys::path::is_separator(name[0])) {
+    name = name.drop_front();
+  }
+  return name.str();
+}
+
+// Table of <file>, at its path below the corpus under the output directory,
+// so that tables of different modules never collide.
+static std::string TablePath(StringRef file) {
+  SmallString<128> path(output_dir);
+  sys::path::append(path, RelativeName(file) + ".csi.tsv");
+  return path.str().str();
+}
+
+// Counts <file> into <module_count> and writes its table. Function bodies
+// are materialized one at a time and dropped once counted.
+static bool CensusFile(const std::string& file, uint64_t* module_count) {
+  LLVMContext ctx;
+  ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(file);
+
+  if (!buffer) {
+    ReportError(file, buffer.getError().message());
+    return false;
+  }
+
+  Expected<std::unique_ptr<Module>> mod_or_err = getOwningLazyBitcodeModule(
+      std::move(*buffer), ctx, true /* ShouldLazyLoadMetadata */);
+  if (!mod_or_err) {
+    ReportError(file, toString(mod_or_err.takeError()));
+    return false;
+  }
+  std::unique_ptr<Module> mod = std::move(*mod_or_err);
+
+  std::string table_path = TablePath(file);
+  std::error_code ec = sys::fs::create_directories(sys::path::parent_path(table_path));
+  if (ec) {
+    ReportError(table_path, ec.message());
+    return false;
+  }
+  raw_fd_ostream table(table_path, ec, sys::fs::F_None);
+  if (ec) {
+    ReportError(table_path, ec.message());
+    return false;
+  }
+
+  PrintHeader(table);
+  for (Function& F : *mod) {
+    if (Error err = F.materialize()) {
+      ReportError(file, toString(std::move(err)));
+      return false;
+    }
+    if (F.isDeclaration()) {
+      continue;
+    }
+
+    uint64_t func_count[kNumOpcodes] = {0};
+    CountOpcodes(F, func_count);
+    F.deleteBody();
+
+    PrintRow(table, F.getName(), func_count);
+    for (unsigned op = 0; op < kNumOpcodes; ++op) {
+      module_count[op] += func_count[op];
+    }
+  }
+  PrintRow(table, "<module>", module_count);
+
+  for (unsigned op = 0; op < kNumOpcodes; ++op) {
+    if (module_count[op] != 0) {
+      total_count[op].fetch_add(module_count[op], std::memory_order_relaxed);
+    }
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+  sys::PrintStackTraceOnErrorSignal(argv[0]);
+  PrettyStackTraceProgram stack_trace(argc, argv);
+  llvm_shutdown_obj shutdown;
+
+  cl::ParseCommandLineOptions(argc, argv, "static instruction census\n");
+
+  if (std::error_code ec = sys::fs::create_directories(output_dir)) {
+    errs() << output_dir << ": " << ec.message() << '\n';
+    return 1;
+  }
+
+  std::vector<std::string> files = FindBitcodeFiles(corpus_dir);
+
+  // Each worker owns one row, so no locking is needed to fill them.
+  std::vector<std::vector<uint64_t>> module_count(
+      files.size(), std::vector<uint64_t>(kNumOpcodes, 0));
+  std::vector<char> ok(files.size(), 0);
+  {
+    ThreadPool pool(num_jobs ? num_jobs : std::thread::hardware_concurrency());
+
+    for (size_t i = 0; i < files.size(); ++i) {
+      pool.async([&, i]() {
+        ok[i] = CensusFile(files[i], module_count[i].data());
+      });
+    }
+    pool.wait();
+  }
+
+  SmallString<128> totals_path(output_dir);
+  sys::path::append(totals_path, "totals.tsv");
+
+  std::error_code ec;
+  raw_fd_ostream totals(totals_path, ec, sys::fs::F_None);
+  if (ec) {
+    errs() << totals_path << ": " << ec.message() << '\n';
+    return 1;
+  }
+
+  uint64_t corpus_count[kNumOpcodes];
+  int failures = 0;
+
+  PrintHeader(totals);
+  for (size_t i = 0; i < files.size(); ++i) {
+    if (ok[i]) {
+      PrintRow(totals, RelativeName(files[i]), module_count[i].data());
+    } else {
+      failures += 1;
+    }
+  }
+  for (unsigned op = 0; op < kNumOpcodes; ++op) {
+    corpus_count[op] = total_count[op].load(std::memory_order_relaxed);
+  }
+  PrintRow(totals, "<total>", corpus_count);
+
+  return failures == 0 ? 0 : 1;
+}
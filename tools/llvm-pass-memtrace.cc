@@ -0,0 +1,335 @@
+// Analyzes the memory access traces sampled by the mt pass.
+//
+//   llvm-pass-memtrace -top 20 llvm-pass.*.trace
+//
+// For every traced load and store it reports, as a tab separated table
+// sorted by samples:
+//
+//   stride        the most frequent distance between consecutive accesses
+//                 of the site, and its share of them
+//   cold          accesses to a cache line not seen before in the burst
+//   far           share of reuses at a stack distance of at least
+//                 -cache-lines lines, which likely missed in the cache
+//   d0, d1, ...   the reuse distance histogram: how many distinct cache
+//                 lines were touched since the last access to the same
+//                 line, in log2 buckets
+//
+// Strides and distances are measured within a burst of consecutive
+// accesses of one thread, the unit in which lib/lib_trace.cc samples.
+
+#include "profile_format.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/PrettyStackTrace.h"
+#include "llvm/Support/Signals.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace llvm;
+
+static cl::list<std::string> input_files(
+    cl::Positional, cl::desc("<input traces>"), cl::OneOrMore);
+
+static cl::opt<std::string> output_file(
+    "o", cl::desc("Report file (default: stdout)"), cl::value_desc("file"),
+    cl::init("-"));
+
+static cl::opt<unsigned> top_count(
+    "top", cl::desc("Only report the N most sampled sites"),
+    cl::value_desc("N"), cl::init(0));
+
+static cl::opt<unsigned> line_size(
+    "line-size", cl::desc("Cache line size in bytes"), cl::init(64));
+
+static cl::opt<unsigned> cache_lines(
+    "cache-lines", cl::desc("Reuse distance, in lines, counted as far"),
+    cl::init(512));
+
+// Reuse distance buckets: 0, 1, 2-3, 4-7, ..., 4096 and more.
+static const unsigned kReuseBuckets = 14;
+
+// Distinct strides kept per site, further ones are counted as irregular.
+static const size_t kMaxStrides = 256;
+
+typedef std::pair<uint64_t, uint32_t> SiteKey;
+
+struct SiteStats {
+  uint32_t info = 0;
+  uint64_t samples = 0;
+  uint64_t cold = 0;
+  uint64_t far = 0;
+  uint64_t irregular = 0;
+  std::map<int64_t, uint64_t> strides;
+  uint64_t reuse[kReuseBuckets] = {0};
+};
+
+// Prefix sums over the positions of a burst, marking the position of the
+// latest access to every line: the marks between two accesses to a line
+// are the distinct lines touched in between.
+class Fenwick {
+ public:
+  explicit Fenwick(size_t n) : tree_(n + 1, 0) { }
+
+  void Add(size_t pos, int delta) {
+    for (++pos; pos < tree_.size(); pos += pos & -pos) {
+      tree_[pos] += delta;
+    }
+  }
+
+  // Sum of the marks at positions below <pos>.
+  int64_t Prefix(size_t pos) const {
+    int64_t sum = 0;
+    for (; pos > 0; pos -= pos & -pos) {
+      sum += tree_[pos];
+    }
+    return sum;
+  }
+
+ private:
+  std::vector<int64_t> tree_;
+};
+
+static unsigned ReuseBucket(uint64_t distance) {
+  if (distance == 0) {
+    return 0;
+  }
+  return std::min<unsigned>(kReuseBuckets - 1, 64 - countLeadingZeros(distance));
+}
+
+// Reads the chunks of <file>. Returns false if it is not a valid trace.
+static bool ReadTrace(StringRef file, std::vector<trace_entry>& entries,
+                      std::map<uint64_t, std::string>& names, uint64_t& dropped) {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(
+      file, -1 /* FileSize */, false /* RequiresNullTerminator */);
+  if (!buffer) {
+    errs() << file << ": " << buffer.getError().message() << '\n';
+    return false;
+  }
+
+  const char* p = (*buffer)->getBufferStart();
+  const char* end = (*buffer)->getBufferEnd();
+
+  if (end - p < (ptrdiff_t) sizeof(trace_header) ||
+      !trace_header_valid(reinterpret_cast<const trace_header*>(p))) {
+    errs() << file << ": not a valid trace\n";
+    return false;
+  }
+  p += sizeof(trace_header);
+
+  while (p != end) {
+    trace_chunk chunk;
+    if (end - p < (ptrdiff_t) sizeof(chunk)) {
+      break;
+    }
+    memcpy(&chunk, p, sizeof(chunk));
+    p += sizeof(chunk);
+
+    if (chunk.type == TRACE_ENTRIES) {
+      size_t size = chunk.count * sizeof(trace_entry);
+      if ((size_t) (end - p) < size) {
+        break;
+      }
+      size_t first = entries.size();
+      entries.resize(first + chunk.count);
+      memcpy(&entries[first], p, size);
+      p += size;
+    } else if (chunk.type == TRACE_DROPPED) {
+      uint64_t n;
+      if ((size_t) (end - p) < sizeof(n)) {
+        break;
+      }
+      memcpy(&n, p, sizeof(n));
+      dropped += n;
+      p += sizeof(n);
+    } else if (chunk.type == TRACE_FUNCTIONS) {
+      size_t size = chunk.count * sizeof(trace_function);
+      uint64_t names_size;
+      if ((size_t) (end - p) < size + sizeof(names_size)) {
+        break;
+      }
+      std::vector<trace_function> funcs(chunk.count);
+      memcpy(funcs.data(), p, size);
+      memcpy(&names_size, p + size, sizeof(names_size));
+      p += size + sizeof(names_size);
+      if ((uint64_t) (end - p) < names_size) {
+        break;
+      }
+      for (const trace_function& func : funcs) {
+        if (func.name_offset + func.name_size <= names_size) {
+          names[func.hash] = std::string(p + func.name_offset, func.name_size);
+        }
+      }
+      p += names_size;
+    } else {
+      break;
+    }
+  }
+
+  if (p != end) {
+    errs() << file << ": truncated or corrupt trace\n";
+    return false;
+  }
+  return true;
+}
+
+// Adds the strides and reuse distances of the burst <begin>..<end>.
+static void AnalyzeBurst(const trace_entry* begin, const trace_entry* end,
+                         std::map<SiteKey, SiteStats>& stats) {
+  Fenwick marks(end - begin);
+  DenseMap<uint64_t, size_t> last_pos;
+  std::map<SiteKey, uint64_t> last_address;
+
+  for (const trace_entry* e = begin; e != end; ++e) {
+    size_t pos = e - begin;
+    SiteKey key(e->func_hash, e->site);
+    SiteStats& site = stats[key];
+
+    site.info = e->info;
+    site.samples += 1;
+
+    auto addr_it = last_address.find(key);
+    if (addr_it != last_address.end()) {
+      int64_t stride = (int64_t) (e->address - addr_it->second);
+      auto stride_it = site.strides.find(stride);
+      if (stride_it != site.strides.end()) {
+        stride_it->second += 1;
+      } else if (site.strides.size() < kMaxStrides) {
+        site.strides[stride] = 1;
+      } else {
+        site.irregular += 1;
+      }
+      addr_it->second = e->address;
+    } else {
+      last_address[key] = e->address;
+    }
+
+    uint64_t line = e->address / line_size;
+    auto line_it = last_pos.find(line);
+    if (line_it == last_pos.end()) {
+      site.cold += 1;
+      last_pos[line] = pos;
+    } else {
+      uint64_t distance = marks.Prefix(pos) - marks.Prefix(line_it->second + 1);
+      site.reuse[ReuseBucket(distance)] += 1;
+      if (distance >= cache_lines) {
+        site.far += 1;
+      }
+      marks.Add(line_it->second, -1);
+      line_it->second = pos;
+    }
+    marks.Add(pos, 1);
+  }
+}
+
+int main(int argc, char** argv) {
+  sys::PrintStackTraceOnErrorSignal(argv[0]);
+  PrettyStackTraceProgram stack_trace(argc, argv);
+  llvm_shutdown_obj shutdown;
+
+  cl::ParseCommandLineOptions(argc, argv, "memory access trace analyzer\n");
+
+  std::map<uint64_t, std::string> names;
+  std::map<SiteKey, SiteStats> stats;
+  uint64_t dropped = 0;
+  int failures = 0;
+
+  for (const std::string& file : input_files) {
+    std::vector<trace_entry> entries;
+    if (!ReadTrace(file, entries, names, dropped)) {
+      failures += 1;
+      continue;
+    }
+
+    // Rings are drained in pieces, so the bursts of different threads are
+    // interleaved; the order within a thread is kept.
+    std::stable_sort(entries.begin(), entries.end(),
+                     [](const trace_entry& a, const trace_entry& b) {
+                       return a.thread != b.thread ? a.thread < b.thread : a.burst < b.burst;
+                     });
+
+    for (size_t i = 0, j; i < entries.size(); i = j) {
+      for (j = i + 1; j < entries.size() && entries[j].thread == entries[i].thread &&
+                      entries[j].burst == entries[i].burst; ++j) {
+      }
+      AnalyzeBurst(&entries[i], &entries[0] + j, stats);
+    }
+  }
+
+  if (dropped > 0) {
+    errs() << "warning: " << dropped << " samples were dropped by full buffers\n";
+  }
+
+  std::vector<std::pair<SiteKey, const SiteStats*>> sites;
+  for (const auto& site : stats) {
+    sites.push_back(std::make_pair(site.first, &site.second));
+  }
+  std::stable_sort(sites.begin(), sites.end(),
+                   [](const std::pair<SiteKey, const SiteStats*>& a,
+                      const std::pair<SiteKey, const SiteStats*>& b) {
+                     return a.second->samples > b.second->samples;
+                   });
+  if (top_count > 0 && sites.size() > top_count) {
+    sites.resize(top_count);
+  }
+
+  std::error_code ec;
+  raw_fd_ostream os(output_file, ec, sys::fs::F_None);
+  if (ec) {
+    errs() << output_file << ": " << ec.message() << '\n';
+    return 1;
+  }
+
+  os << "function\tsite\taccess\tsize\tsamples\tstride\tstride_share\tcold\tfar";
+  for (unsigned b = 0; b < kReuseBuckets; ++b) {
+    os << "\td" << (b == 0 ? 0 : 1ULL << (b - 1));
+  }
+  os << '\n';
+
+  for (const auto& site : sites) {
+    const SiteStats& st = *site.second;
+    auto name_it = names.find(site.first.first);
+
+    uint64_t num_strides = st.irregular;
+    std::pair<int64_t, uint64_t> top_stride(0, 0);
+    for (const auto& stride : st.strides) {
+      num_strides += stride.second;
+      if (stride.second > top_stride.second) {
+        top_stride = stride;
+      }
+    }
+    uint64_t num_reuses = st.samples - st.cold;
+
+    os << (name_it != names.end() ? name_it->second : utohexstr(site.first.first))
+       << '\t' << site.first.second
+       << '\t' << ((st.info & TRACE_STORE) ? "store" : "load")
+       << '\t' << (st.info >> 1)
+       << '\t' << st.samples;
+    if (num_strides > 0) {
+      os << '\t' << top_stride.first << '\t'
+         << format("%.2f", (double) top_stride.second / num_strides);
+    } else {
+      os << "\t-\t-";
+    }
+    os << '\t' << st.cold << '\t'
+       << format("%.2f", num_reuses > 0 ? (double) st.far / num_reuses : 0.0);
+    for (unsigned b = 0; b < kReuseBuckets; ++b) {
+      os << '\t' << st.reuse[b];
+    }
+    os << '\n';
+  }
+
+  return failures == 0 ? 0 : 1;
+}
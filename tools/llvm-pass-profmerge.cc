@@ -0,0 +1,410 @@
+// Merges the profiles written by instrumented runs into one, summing the
+// counters of every (function, kind, site, slot).
+//
+//   llvm-pass-profmerge -j 8 -o merged.prof -top 20 llvm-pass.*.prof
+//
+// The inputs are split into one contiguous shard per worker thread. Each
+// worker maps its files and folds them into a private sorted table, so no
+// locking is needed while merging; the shards are then combined in input
+// order. A function whose CFG checksum disagrees with the one seen first is
+// dropped from that input, its counters would not line up.
+//
+// With -top N, the N hottest blocks and functions of the merged profile, and
+// the trip count histograms of the N most entered loops, are printed to
+// stdout.
+//
+// With -coverage, the inputs are coverage bitmaps (lib/lib_cov.cc) instead,
+// merged by or-ing the bits of each block. -top N then prints the N
+// functions with the most blocks that never ran.
+
+#include "ProfileData.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/Mutex.h"
+#include "llvm/Support/PrettyStackTrace.h"
+#include "llvm/Support/Signals.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace llvm;
+
+static cl::list<std::string> input_files(
+    cl::Positional, cl::desc("<input profiles>"), cl::OneOrMore);
+
+static cl::opt<std::string> output_file(
+    "o", cl::desc("Merged profile"), cl::value_desc("file"),
+    cl::init("merged.prof"));
+
+static cl::opt<unsigned> num_jobs(
+    "j", cl::desc("Number of worker threads (default: all cores)"),
+    cl::init(0));
+
+static cl::opt<unsigned> top_count(
+    "top", cl::desc("Print the N hottest blocks and functions"),
+    cl::value_desc("N"), cl::init(0));
+
+static cl::opt<bool> merge_coverage(
+    "coverage", cl::desc("Merge coverage bitmaps instead of profiles"),
+    cl::init(false));
+
+static sys::Mutex diag_lock;
+
+static void ReportError(const Twine& msg) {
+  sys::ScopedLock lock(diag_lock);
+  errs() << msg << '\n';
+}
+
+// A partially merged profile.
+struct MergedProfile {
+  std::map<uint64_t, ProfileFunction> functions;
+  std::vector<prof_record> records;
+  unsigned failures = 0;
+};
+
+// Adds the sorted <records> to the sorted <into>, summing equal keys and
+// leaving out the functions in <skip>.
+static void MergeRecords(std::vector<prof_record>& into, ArrayRef<prof_record> records,
+                         const std::set<uint64_t>& skip) {
+  std::vector<prof_record> merged;
+  merged.reserve(std::max(into.size(), records.size()));
+
+  auto a = into.begin(), a_end = into.end();
+  auto b = records.begin(), b_end = records.end();
+  while (a != a_end || b != b_end) {
+    if (b != b_end && skip.count(b->func_hash)) {
+      ++b;
+    } else if (b == b_end || (a != a_end && prof_record_less(*a, *b))) {
+      merged.push_back(*a++);
+    } else if (a == a_end || prof_record_less(*b, *a)) {
+      merged.push_back(*b++);
+    } else {
+      merged.push_back(*a++);
+      merged.back().count = SaturatingAdd(merged.back().count, b->count);
+      ++b;
+    }
+  }
+  into.swap(merged);
+}
+
+// Adds <func> to <into>, or to <skip> if its checksum differs from the one
+// already in <into>.
+static void MergeFunction(MergedProfile& into, uint64_t hash, const ProfileFunction& func,
+                           std::set<uint64_t>& skip, StringRef origin) {
+  auto it = into.functions.insert(std::make_pair(hash, func)).first;
+
+  if (it->second.cfg_checksum != func.cfg_checksum) {
+    ReportError(origin + ": " + func.name + " has a different CFG, skipped");
+    skip.insert(hash);
+  }
+}
+
+static void MergeFile(MergedProfile& into, const std::string& file) {
+  std::string error;
+  std::unique_ptr<ProfileReader> reader = ProfileReader::Open(file, error);
+
+  if (!reader) {
+    ReportError(error);
+    into.failures += 1;
+    return;
+  }
+
+  std::set<uint64_t> skip;
+  for (const prof_function& func : reader->functions()) {
+    ProfileFunction entry = {func.cfg_checksum, reader->name(func).str()};
+    MergeFunction(into, func.hash, entry, skip, file);
+  }
+  MergeRecords(into.records, reader->records(), skip);
+}
+
+static void MergeShard(MergedProfile& into, const MergedProfile& shard) {
+  std::set<uint64_t> skip;
+
+  for (const auto& func : shard.functions) {
+    MergeFunction(into, func.first, func.second, skip, "<merge>");
+  }
+  MergeRecords(into.records, shard.records, skip);
+  into.failures += shard.failures;
+}
+
+// Prints the trip count histograms of the loops entered most often, one
+// "<lowest trip count>:<entries>" per nonempty bucket.
+static void PrintLoopTrips(raw_ostream& os, const MergedProfile& profile) {
+  struct LoopTrips {
+    uint64_t entries;
+    const prof_record* begin;
+    const prof_record* end;
+  };
+  std::vector<LoopTrips> loops;
+
+  for (const prof_record& record : profile.records) {
+    if (record.kind != PROF_LOOP_TRIPS) {
+      continue;
+    }
+    if (loops.empty() || loops.back().begin->func_hash != record.func_hash ||
+        loops.back().begin->site != record.site) {
+      loops.push_back(LoopTrips{0, &record, &record});
+    }
+    loops.back().entries = SaturatingAdd(loops.back().entries, record.count);
+    loops.back().end = &record + 1;
+  }
+  if (loops.empty()) {
+    return;
+  }
+
+  size_t n = std::min<size_t>(top_count, loops.size());
+  std::partial_sort(loops.begin(), loops.begin() + n, loops.end(),
+                    [](const LoopTrips& a, const LoopTrips& b) {
+                      return a.entries > b.entries;
+                    });
+
+  os << "most entered loops (trip count histogram):\n";
+  for (size_t i = 0; i < n; ++i) {
+    os << "  " << loops[i].entries << '\t' << profile.functions.at(loops[i].begin->func_hash).name
+       << "\tloop at block " << loops[i].begin->site;
+    char separator = '\t';
+    for (const prof_record* record = loops[i].begin; record != loops[i].end; ++record) {
+      if (record->count != 0) {
+        os << separator << (1ULL << record->slot) << ':' << record->count;
+        separator = ' ';
+      }
+    }
+    os << '\n';
+  }
+}
+
+// Prints the <top_count> functions with the highest <totals>.
+static void PrintTopFunctions(raw_ostream& os, StringRef title, const MergedProfile& profile,
+                              const std::map<uint64_t, uint64_t>& totals) {
+  std::vector<std::pair<uint64_t, uint64_t>> funcs(totals.begin(), totals.end());
+  size_t n = std::min<size_t>(top_count, funcs.size());
+  std::partial_sort(funcs.begin(), funcs.begin() + n, funcs.end(),
+                    [](const std::pair<uint64_t, uint64_t>& a,
+                       const std::pair<uint64_t, uint64_t>& b) {
+                      return a.second > b.second;
+                    });
+
+  os << "hottest functions (" << title << "):\n";
+  for (size_t i = 0; i < n; ++i) {
+    os << "  " << funcs[i].second << '\t' << profile.functions.at(funcs[i].first).name << '\n';
+  }
+}
+
+// Prints the <top_count> highest of the block records <blocks>, whose slots
+// are <what>s.
+static void PrintTopBlocks(raw_ostream& os, StringRef title, const MergedProfile& profile,
+                           std::vector<const prof_record*>& blocks,
+                           StringRef what = "block") {
+  size_t n = std::min<size_t>(top_count, blocks.size());
+  std::partial_sort(blocks.begin(), blocks.begin() + n, blocks.end(),
+                    [](const prof_record* a, const prof_record* b) {
+                      return a->count > b->count;
+                    });
+
+  os << "hottest " << what << "s (" << title << "):\n";
+  for (size_t i = 0; i < n; ++i) {
+    os << "  " << blocks[i]->count << '\t' << profile.functions.at(blocks[i]->func_hash).name
+       << '\t' << what << ' ' << blocks[i]->slot << '\n';
+  }
+}
+
+static void PrintTop(raw_ostream& os, const MergedProfile& profile) {
+  std::vector<const prof_record*> blocks;
+  std::vector<const prof_record*> sampled_blocks;
+  std::vector<const prof_record*> calls;
+  std::map<uint64_t, uint64_t> func_total;
+  std::map<uint64_t, uint64_t> func_cycles;
+  std::map<uint64_t, uint64_t> func_samples;
+
+  for (const prof_record& record : profile.records) {
+    if (record.kind == PROF_BLOCK) {
+      blocks.push_back(&record);
+      func_total[record.func_hash] = SaturatingAdd(func_total[record.func_hash], record.count);
+    } else if (record.kind == PROF_CYCLES) {
+      func_cycles[record.func_hash] = SaturatingAdd(func_cycles[record.func_hash], record.count);
+    } else if (record.kind == PROF_SAMPLES) {
+      sampled_blocks.push_back(&record);
+      func_samples[record.func_hash] = SaturatingAdd(func_samples[record.func_hash], record.count);
+    } else if (record.kind == PROF_CALL) {
+      calls.push_back(&record);
+    }
+  }
+
+  if (!blocks.empty()) {
+    PrintTopBlocks(os, "executions", profile, blocks);
+    PrintTopFunctions(os, "block executions", profile, func_total);
+  }
+  if (!func_cycles.empty()) {
+    PrintTopFunctions(os, "estimated cycles", profile, func_cycles);
+  }
+  if (!sampled_blocks.empty()) {
+    PrintTopBlocks(os, "PC samples", profile, sampled_blocks);
+    PrintTopFunctions(os, "PC samples", profile, func_samples);
+  }
+  if (!calls.empty()) {
+    PrintTopBlocks(os, "executions", profile, calls, "call");
+  }
+
+  PrintLoopTrips(os, profile);
+}
+
+// A partially merged coverage bitmap.
+struct MergedCoverage {
+  std::map<uint64_t, CoverageFunction> functions;
+  unsigned failures = 0;
+};
+
+// Ors the blocks of <func> into <into>, unless it has a different CFG.
+static void MergeCoverageFunction(MergedCoverage& into, uint64_t hash,
+                                  const CoverageFunction& func, StringRef origin) {
+  auto inserted = into.functions.insert(std::make_pair(hash, func));
+  if (inserted.second) {
+    return;
+  }
+
+  CoverageFunction& merged = inserted.first->second;
+  if (merged.cfg_checksum != func.cfg_checksum ||
+      merged.covered.size() != func.covered.size()) {
+    ReportError(origin + ": " + func.name + " has a different CFG, skipped");
+    return;
+  }
+  for (size_t i = 0; i < func.covered.size(); ++i) {
+    if (func.covered[i]) {
+      merged.covered[i] = true;
+    }
+  }
+}
+
+static void MergeCoverageFile(MergedCoverage& into, const std::string& file) {
+  std::string error;
+  std::unique_ptr<CoverageReader> reader = CoverageReader::Open(file, error);
+
+  if (!reader) {
+    ReportError(error);
+    into.failures += 1;
+    return;
+  }
+
+  for (const cov_function& func : reader->functions()) {
+    CoverageFunction entry = {func.cfg_checksum, reader->name(func).str(),
+                              std::vector<bool>(func.num_blocks)};
+    for (uint64_t i = 0; i < func.num_blocks; ++i) {
+      entry.covered[i] = reader->covered(func, i);
+    }
+    MergeCoverageFunction(into, func.hash, entry, file);
+  }
+}
+
+static void MergeCoverageShard(MergedCoverage& into, const MergedCoverage& shard) {
+  for (const auto& func : shard.functions) {
+    MergeCoverageFunction(into, func.first, func.second, "<merge>");
+  }
+  into.failures += shard.failures;
+}
+
+static void PrintUncovered(raw_ostream& os, const MergedCoverage& coverage) {
+  std::vector<std::pair<uint64_t, const CoverageFunction*>> funcs;
+  uint64_t num_blocks = 0, num_uncovered = 0, num_dead_funcs = 0;
+
+  for (const auto& func : coverage.functions) {
+    uint64_t uncovered = std::count(func.second.covered.begin(),
+                                    func.second.covered.end(), false);
+
+    num_blocks += func.second.covered.size();
+    num_uncovered += uncovered;
+    if (uncovered == func.second.covered.size()) {
+      num_dead_funcs += 1;
+    }
+    funcs.push_back(std::make_pair(uncovered, &func.second));
+  }
+
+  size_t n = std::min<size_t>(top_count, funcs.size());
+  std::partial_sort(funcs.begin(), funcs.begin() + n, funcs.end(),
+                    [](const std::pair<uint64_t, const CoverageFunction*>& a,
+                       const std::pair<uint64_t, const CoverageFunction*>& b) {
+                      return a.first > b.first;
+                    });
+
+  os << num_uncovered << " of " << num_blocks << " blocks never ran, "
+     << num_dead_funcs << " of " << coverage.functions.size()
+     << " functions never entered\n";
+  os << "functions with most blocks never run:\n";
+  for (size_t i = 0; i < n; ++i) {
+    os << "  " << funcs[i].first << '/' << funcs[i].second->covered.size() << '\t'
+       << funcs[i].second->name << '\n';
+  }
+}
+
+// Folds the inputs into one <Merged> per worker thread, each from its own
+// contiguous shard of the inputs.
+template <typename Merged>
+static std::vector<Merged> MergeInShards(void (*merge_file)(Merged&, const std::string&)) {
+  unsigned num_shards = num_jobs ? num_jobs : std::thread::hardware_concurrency();
+  num_shards = std::max(1u, std::min<unsigned>(num_shards, input_files.size()));
+
+  std::vector<Merged> shards(num_shards);
+  ThreadPool pool(num_shards);
+
+  for (unsigned s = 0; s < num_shards; ++s) {
+    pool.async([&, s]() {
+      size_t begin = input_files.size() * s / num_shards;
+      size_t end = input_files.size() * (s + 1) / num_shards;
+
+      for (size_t i = begin; i < end; ++i) {
+        merge_file(shards[s], input_files[i]);
+      }
+    });
+  }
+  pool.wait();
+  return shards;
+}
+
+int main(int argc, char** argv) {
+  sys::PrintStackTraceOnErrorSignal(argv[0]);
+  PrettyStackTraceProgram stack_trace(argc, argv);
+  llvm_shutdown_obj shutdown;
+
+  cl::ParseCommandLineOptions(argc, argv, "profile merger\n");
+
+  std::string error;
+
+  if (merge_coverage) {
+    std::vector<MergedCoverage> shards = MergeInShards(MergeCoverageFile);
+    MergedCoverage merged = std::move(shards[0]);
+    for (size_t s = 1; s < shards.size(); ++s) {
+      MergeCoverageShard(merged, shards[s]);
+    }
+
+    if (!WriteCoverage(output_file, merged.functions, error)) {
+      errs() << error << '\n';
+      return 1;
+    }
+    if (top_count > 0) {
+      PrintUncovered(outs(), merged);
+    }
+    return merged.failures == 0 ? 0 : 1;
+  }
+
+  std::vector<MergedProfile> shards = MergeInShards(MergeFile);
+  MergedProfile merged = std::move(shards[0]);
+  for (size_t s = 1; s < shards.size(); ++s) {
+    MergeShard(merged, shards[s]);
+  }
+
+  if (!WriteProfile(output_file, merged.functions, merged.records, error)) {
+    errs() << error << '\n';
+    return 1;
+  }
+  if (top_count > 0) {
+    PrintTop(outs(), merged);
+  }
+  return merged.failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,253 @@
+// Runs the passes of this project in-process over many IR files at once,
+// instead of starting one opt process per pass and file.
+//
+//   llvm-pass-run -passes=liveness,reaching -j 8 -o out a.bc b.bc ...
+//
+// Every input is parsed once and all requested passes run on it in a single
+// pass manager. What the passes print goes to <out>/<input>.result, and
+// with -emit-bc the (possibly instrumented) module to <out>/<input>.bc.
+//
+// With -stream, bitcode is opened lazily and function passes run on one
+// function at a time, whose body is freed again before the next one is
+// read, so memory tracks the largest function rather than the module.
+
+#include "ResultStream.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/InitializePasses.h"
+#include "llvm/Pass.h"
+#include "llvm/PassInfo.h"
+#include "llvm/PassRegistry.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Mutex.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/PrettyStackTrace.h"
+#include "llvm/Support/Signals.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace llvm;
+
+static cl::list<std::string> input_files(
+    cl::Positional, cl::desc("<input bitcode or IR files>"), cl::OneOrMore);
+
+static cl::list<std::string> pass_names(
+    "passes", cl::desc("Comma separated passes to run, e.g. liveness,csi"),
+    cl::CommaSeparated, cl::OneOrMore);
+
+static cl::opt<std::string> output_dir(
+    "o", cl::desc("Directory receiving the results"),
+    cl::value_desc("directory"), cl::init("."));
+
+static cl::opt<unsigned> num_jobs(
+    "j", cl::desc("Number of worker threads (default: all cores)"),
+    cl::init(0));
+
+static cl::opt<bool> emit_bitcode(
+    "emit-bc", cl::desc("Also write each module after the passes ran"),
+    cl::init(false));
+
+static cl::opt<bool> stream_functions(
+    "stream", cl::desc("Materialize one function at a time (function passes "
+                       "only, bitcode input only)"),
+    cl::init(false));
+
+static sys::Mutex diag_lock;
+
+// Reports <msg> for <file> without interleaving with other workers.
+static void ReportError(StringRef file, const Twine& msg) {
+  sys::ScopedLock lock(diag_lock);
+  errs() << file << ": " << msg << '\n';
+}
+
+// Picks "<out>/<file name>" for every input, numbering clashing names.
+static std::vector<std::string> ChooseOutputStems() {
+  std::vector<std::string> stems;
+  std::map<std::string, int> seen;
+
+  for (const std::string& file : input_files) {
+    std::string name = sys::path::filename(file).str();
+    int n = seen[name]++;
+    if (n > 0) {
+      name += "." + utostr(n);
+    }
+
+    SmallString<128> path(output_dir);
+    sys::path::append(path, name);
+    stems.push_back(path.str().str());
+  }
+  return stems;
+}
+
+// Runs the function <passes> over the lazily loaded bitcode <file>, one
+// function body in memory at a time.
+static bool StreamFile(const std::string& file, raw_ostream& result,
+                       const std::vector<const PassInfo*>& passes) {
+  LLVMContext ctx;
+  ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(file);
+
+  if (!buffer) {
+    ReportError(file, buffer.getError().message());
+    return false;
+  }
+
+  Expected<std::unique_ptr<Module>> mod_or_err = getOwningLazyBitcodeModule(
+      std::move(*buffer), ctx, true /* ShouldLazyLoadMetadata */);
+  if (!mod_or_err) {
+    ReportError(file, toString(mod_or_err.takeError()));
+    return false;
+  }
+  std::unique_ptr<Module> mod = std::move(*mod_or_err);
+
+  legacy::FunctionPassManager fpm(mod.get());
+  for (const PassInfo* info : passes) {
+    fpm.add(info->createPass());
+  }
+
+  SetResultStream(&result);
+  fpm.doInitialization();
+  for (Function& F : *mod) {
+    if (F.isMaterializable()) {
+      if (Error err = F.materialize()) {
+        ReportError(file, toString(std::move(err)));
+        SetResultStream(nullptr);
+        return false;
+      }
+    }
+    if (F.isDeclaration()) {
+      continue;
+    }
+
+    fpm.run(F);
+
+    // Nothing refers to the body once the passes are done with it.
+    F.deleteBody();
+  }
+  fpm.doFinalization();
+  SetResultStream(nullptr);
+  return true;
+}
+
+static bool RunOnFile(const std::string& file, const std::string& stem,
+                      const std::vector<const PassInfo*>& passes) {
+  std::error_code ec;
+  raw_fd_ostream result(stem + ".result", ec, sys::fs::F_None);
+  if (ec) {
+    ReportError(stem + ".result", ec.message());
+    return false;
+  }
+
+  if (stream_functions) {
+    return StreamFile(file, result, passes);
+  }
+
+  LLVMContext ctx;
+  SMDiagnostic diag;
+  std::unique_ptr<Module> mod = parseIRFile(file, diag, ctx);
+
+  if (!mod) {
+    std::string msg;
+    raw_string_ostream os(msg);
+    diag.print("llvm-pass-run", os);
+    ReportError(file, os.str());
+    return false;
+  }
+
+  legacy::PassManager pm;
+  for (const PassInfo* info : passes) {
+    pm.add(info->createPass());
+  }
+  if (emit_bitcode) {
+    pm.add(createVerifierPass());
+  }
+
+  SetResultStream(&result);
+  pm.run(*mod);
+  SetResultStream(nullptr);
+
+  if (emit_bitcode) {
+    raw_fd_ostream bitcode(stem + ".bc", ec, sys::fs::F_None);
+    if (ec) {
+      ReportError(stem + ".bc", ec.message());
+      return false;
+    }
+    WriteBitcodeToFile(mod.get(), bitcode);
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+  sys::PrintStackTraceOnErrorSignal(argv[0]);
+  PrettyStackTraceProgram stack_trace(argc, argv);
+  llvm_shutdown_obj shutdown;
+
+  PassRegistry& registry = *PassRegistry::getPassRegistry();
+  initializeCore(registry);
+  initializeAnalysis(registry);
+  initializeTransformUtils(registry);
+
+  cl::ParseCommandLineOptions(argc, argv, "batch driver for the LLVM passes\n");
+
+  std::vector<const PassInfo*> passes;
+  for (const std::string& name : pass_names) {
+    const PassInfo* info = registry.getPassInfo(name);
+    if (info == nullptr || info->getNormalCtor() == nullptr) {
+      errs() << argv[0] << ": unknown pass '" << name << "'\n";
+      return 1;
+    }
+    passes.push_back(info);
+
+    if (stream_functions) {
+      std::unique_ptr<Pass> pass(info->createPass());
+      if (pass->getPassKind() != PT_Function) {
+        errs() << argv[0] << ": -stream only runs function passes, '"
+               << name << "' is not one\n";
+        return 1;
+      }
+    }
+  }
+
+  if (stream_functions && emit_bitcode) {
+    errs() << argv[0] << ": -stream cannot be combined with -emit-bc\n";
+    return 1;
+  }
+
+  if (std::error_code ec = sys::fs::create_directories(output_dir)) {
+    errs() << output_dir << ": " << ec.message() << '\n';
+    return 1;
+  }
+
+  std::vector<std::string> stems = ChooseOutputStems();
+  std::atomic<int> failures(0);
+  {
+    ThreadPool pool(num_jobs ? num_jobs : std::thread::hardware_concurrency());
+
+    for (size_t i = 0; i < input_files.size(); ++i) {
+      pool.async([&, i]() {
+        if (!RunOnFile(input_files[i], stems[i], passes)) {
+          failures += 1;
+        }
+      });
+    }
+    pool.wait();
+  }
+
+  return failures == 0 ? 0 : 1;
+}